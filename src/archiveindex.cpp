@@ -0,0 +1,341 @@
+#include "archiveindex.h"
+#include "binaryio.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <zlib.h>
+
+#include <osquery/logger/logger.h>
+
+namespace {
+constexpr char kIndexMagic[8] = {'S', 'N', 'T', 'A', 'I', 'D', 'X', '\0'};
+
+// Bump whenever the layout of the file or of a serialized store changes
+const std::uint32_t kIndexVersion = 2;
+
+// Header of the index file. The payload that follows is covered by its
+// checksum; everything is in the host's byte order. The payload starts at an
+// offset aligned for any column, so that the stores are read in place.
+struct IndexHeader final {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t schema; // checksum of kLogFields, which the stores depend on
+  std::uint64_t event_types;
+  std::uint64_t payload_size;
+  std::uint32_t payload_crc;
+  std::uint32_t reserved;
+};
+
+static_assert(sizeof(IndexHeader) % alignof(std::int64_t) == 0,
+              "the payload must stay aligned");
+
+std::uint32_t getSchemaChecksum() {
+  auto checksum = crc32(0L, Z_NULL, 0);
+  for (const auto& field : kLogFields) {
+    checksum = crc32(checksum,
+                     reinterpret_cast<const Bytef*>(field.key.data()),
+                     static_cast<uInt>(field.key.size()));
+
+    auto type = static_cast<unsigned char>(field.type);
+    checksum = crc32(checksum, &type, 1);
+  }
+
+  return static_cast<std::uint32_t>(checksum);
+}
+
+// Continues the checksum of the payload read before this part of it
+std::uint32_t getPayloadChecksum(std::string_view payload,
+                                 std::uint32_t checksum = 0) {
+  // crc32 takes at most 4 GiB at a time
+  while (!payload.empty()) {
+    auto size = std::min<size_t>(payload.size(), 1U << 30);
+    checksum = static_cast<std::uint32_t>(
+        crc32(checksum,
+              reinterpret_cast<const Bytef*>(payload.data()),
+              static_cast<uInt>(size)));
+    payload.remove_prefix(size);
+  }
+
+  return checksum;
+}
+
+bool writeAll(int fd, std::string_view data, off_t offset) {
+  while (!data.empty()) {
+    auto num_written = pwrite(fd, data.data(), data.size(), offset);
+    if (num_written < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (num_written <= 0) {
+      return false;
+    }
+
+    data.remove_prefix(static_cast<size_t>(num_written));
+    offset += num_written;
+  }
+
+  return true;
+}
+
+// Writes the payload to the index file as it is produced, so that only the
+// store being serialized is held in memory, and checksums it on the way
+class PayloadWriter final {
+ public:
+  explicit PayloadWriter(int fd) : fd_(fd) {}
+
+  // What to append the payload to. Only whole multiples of the column
+  // alignment are written out, so the buffer always starts at an aligned
+  // offset and padding computed within it is the same as in the file.
+  std::string& buffer() {
+    return buffer_;
+  }
+
+  // Writes out the buffer, keeping its unaligned end unless it is the last
+  bool flush(bool last) {
+    auto size = last ? buffer_.size()
+                     : buffer_.size() - buffer_.size() % alignof(std::int64_t);
+
+    std::string_view data(buffer_.data(), size);
+    succeeded_ = succeeded_ &&
+                 writeAll(fd_,
+                          data,
+                          static_cast<off_t>(sizeof(IndexHeader) + written_));
+
+    checksum_ = getPayloadChecksum(data, checksum_);
+    written_ += size;
+    buffer_.erase(0, size);
+    return succeeded_;
+  }
+
+  std::uint64_t size() const {
+    return written_;
+  }
+
+  std::uint32_t checksum() const {
+    return checksum_;
+  }
+
+ private:
+  int fd_;
+  std::string buffer_;
+  std::uint64_t written_{0};
+  std::uint32_t checksum_{0};
+  bool succeeded_{true};
+};
+
+void appendFingerprint(std::string& output,
+                       const ArchiveFingerprint& fingerprint) {
+  appendBinary(output, static_cast<std::uint64_t>(fingerprint.inode));
+  appendBinary(output, static_cast<std::int64_t>(fingerprint.size));
+  appendBinary(output, static_cast<std::int64_t>(fingerprint.mtime));
+  appendBinary(output, fingerprint.head_crc);
+}
+
+bool readFingerprint(std::string_view& input, ArchiveFingerprint& fingerprint) {
+  std::uint64_t inode;
+  std::int64_t size;
+  std::int64_t mtime;
+  if (!readBinary(input, inode) || !readBinary(input, size) ||
+      !readBinary(input, mtime) || !readBinary(input, fingerprint.head_crc)) {
+    return false;
+  }
+
+  fingerprint.inode = static_cast<ino_t>(inode);
+  fingerprint.size = static_cast<off_t>(size);
+  fingerprint.mtime = static_cast<time_t>(mtime);
+  return true;
+}
+
+bool readPayload(std::string_view payload,
+                 const std::shared_ptr<const void>& mapping,
+                 const SantaEventTypeSet& event_types,
+                 ArchiveCache& archives,
+                 std::set<ArchiveFingerprint>& evicted_archives) {
+  std::uint64_t archive_count;
+  if (!readBinary(payload, archive_count)) {
+    return false;
+  }
+
+  for (std::uint64_t i = 0; i < archive_count; ++i) {
+    ArchiveFingerprint fingerprint;
+    std::uint32_t partition_count;
+    if (!readFingerprint(payload, fingerprint) ||
+        !readBinary(payload, partition_count)) {
+      return false;
+    }
+
+    auto partitions = std::make_shared<EventPartitions>();
+    for (std::uint32_t j = 0; j < partition_count; ++j) {
+      std::uint32_t type;
+      DecisionStore store;
+      if (!readBinary(payload, type) || type >= kSantaEventTypeCount ||
+          !store.deserialize(payload, mapping)) {
+        return false;
+      }
+
+      if (event_types.test(type)) {
+        (*partitions)[static_cast<SantaEventType>(type)] = std::move(store);
+      }
+    }
+
+    archives[fingerprint] = std::move(partitions);
+  }
+
+  std::uint64_t evicted_count;
+  if (!readBinary(payload, evicted_count)) {
+    return false;
+  }
+
+  for (std::uint64_t i = 0; i < evicted_count; ++i) {
+    ArchiveFingerprint fingerprint;
+    if (!readFingerprint(payload, fingerprint)) {
+      return false;
+    }
+
+    evicted_archives.insert(fingerprint);
+  }
+
+  return payload.empty();
+}
+} // namespace
+
+bool loadArchiveIndex(const std::string& path,
+                      const SantaEventTypeSet& event_types,
+                      ArchiveCache& archives,
+                      std::set<ArchiveFingerprint>& evicted_archives) {
+  archives.clear();
+  evicted_archives.clear();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(IndexHeader)) {
+    close(fd);
+    return false;
+  }
+
+  auto size = static_cast<size_t>(file_stat.st_size);
+  void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (address == MAP_FAILED) {
+    VLOG(1) << "Failed to map the Santa archive index: " << path;
+    return false;
+  }
+
+  // The stores read their columns and strings in place, and keep the mapping
+  // until the last of them is gone. saveArchiveIndex renames a new file over
+  // the index instead of rewriting it, so the mapped file never changes.
+  std::shared_ptr<const void> mapping(
+      address, [size](const void* mapped) {
+        munmap(const_cast<void*>(mapped), size);
+      });
+
+  std::string_view contents(static_cast<const char*>(address), size);
+
+  IndexHeader header;
+  readBinary(contents, header);
+
+  bool succeeded = false;
+  if (std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      header.version != kIndexVersion || header.schema != getSchemaChecksum()) {
+    VLOG(1) << "Ignoring a Santa archive index from another version: " << path;
+
+  } else if ((event_types & ~SantaEventTypeSet(header.event_types)).any()) {
+    VLOG(1) << "Ignoring a Santa archive index lacking some event types";
+
+  } else if (header.payload_size != contents.size() ||
+             header.payload_crc != getPayloadChecksum(contents)) {
+    VLOG(1) << "Ignoring a damaged Santa archive index: " << path;
+
+  } else {
+    succeeded = readPayload(
+        contents, mapping, event_types, archives, evicted_archives);
+    if (!succeeded) {
+      VLOG(1) << "Ignoring a malformed Santa archive index: " << path;
+    }
+  }
+
+  if (!succeeded) {
+    archives.clear();
+    evicted_archives.clear();
+    return false;
+  }
+
+  VLOG(1) << "Loaded " << archives.size()
+          << " parsed archives from the Santa archive index";
+  return true;
+}
+
+bool saveArchiveIndex(const std::string& path,
+                      const SantaEventTypeSet& event_types,
+                      const ArchiveCache& archives,
+                      const std::set<ArchiveFingerprint>& evicted_archives) {
+  // Written aside and renamed over the old index, so that a reader never
+  // sees a partial file
+  auto temporary_path = path + ".tmp";
+  int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    VLOG(1) << "Failed to create the Santa archive index: " << temporary_path;
+    return false;
+  }
+
+  // The header goes in front once the payload is written
+  PayloadWriter writer(fd);
+  auto& payload = writer.buffer();
+  appendBinary(payload, static_cast<std::uint64_t>(archives.size()));
+  for (const auto& archive : archives) {
+    appendFingerprint(payload, archive.first);
+    appendBinary(payload, static_cast<std::uint32_t>(archive.second->size()));
+    for (const auto& partition : *archive.second) {
+      appendBinary(payload, static_cast<std::uint32_t>(partition.first));
+      partition.second.serialize(payload);
+      writer.flush(false);
+    }
+  }
+
+  appendBinary(payload, static_cast<std::uint64_t>(evicted_archives.size()));
+  for (const auto& fingerprint : evicted_archives) {
+    appendFingerprint(payload, fingerprint);
+  }
+
+  bool succeeded = writer.flush(true);
+
+  IndexHeader header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kIndexVersion;
+  header.schema = getSchemaChecksum();
+  header.event_types = event_types.to_ullong();
+  header.payload_size = writer.size();
+  header.payload_crc = writer.checksum();
+
+  succeeded = succeeded &&
+              writeAll(fd,
+                       std::string_view(reinterpret_cast<const char*>(&header),
+                                        sizeof(header)),
+                       0);
+
+  if (close(fd) != 0) {
+    succeeded = false;
+  }
+
+  if (!succeeded || rename(temporary_path.c_str(), path.c_str()) != 0) {
+    VLOG(1) << "Failed to write the Santa archive index: " << path;
+    unlink(temporary_path.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include "decisionstore.h"
+#include "santa.h"
+
+// Parsed events, partitioned by event type
+using EventPartitions = std::map<SantaEventType, DecisionStore>;
+
+// Parsed events that are no longer modified and may be shared between threads
+using SharedPartitions = std::shared_ptr<const EventPartitions>;
+
+// Identifies an archive independently of its name, so that an archive that
+// newsyslog renumbers (santa.log.0.gz -> santa.log.1.gz) is still recognized.
+// The checksum of the first block guards against inode reuse.
+struct ArchiveFingerprint final {
+  ino_t inode{0};
+  off_t size{0};
+  time_t mtime{0};
+  std::uint32_t head_crc{0};
+
+  bool operator<(const ArchiveFingerprint& other) const {
+    return std::tie(inode, size, mtime, head_crc) <
+           std::tie(other.inode, other.size, other.mtime, other.head_crc);
+  }
+
+  bool operator==(const ArchiveFingerprint& other) const {
+    return std::tie(inode, size, mtime, head_crc) ==
+           std::tie(other.inode, other.size, other.mtime, other.head_crc);
+  }
+};
+
+using ArchiveCache = std::map<ArchiveFingerprint, SharedPartitions>;
+
+// Reads the parsed archives saved by saveArchiveIndex through a read-only
+// mapping of the file, which the stores are then served from. Only the
+// partitions of the given event types are loaded, and nothing at all if the
+// index lacks some of them, was written by another version of the extension
+// or fails its checksum.
+bool loadArchiveIndex(const std::string& path,
+                      const SantaEventTypeSet& event_types,
+                      ArchiveCache& archives,
+                      std::set<ArchiveFingerprint>& evicted_archives);
+
+// Replaces the index file with the given parsed archives, and the archives
+// that were evicted from the cache
+bool saveArchiveIndex(const std::string& path,
+                      const SantaEventTypeSet& event_types,
+                      const ArchiveCache& archives,
+                      const std::set<ArchiveFingerprint>& evicted_archives);
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Helpers for the native-endian binary files the extension keeps for itself.
+// Readers consume input from the front and return false on a short read.
+//
+// Arrays that are read in place are aligned for their type. Padding is
+// relative to the start of the output when writing, and to the address of
+// the input when reading, so the file must be written at an aligned offset
+// and read from an aligned buffer, such as a mapping of the file.
+
+template <typename T>
+void appendBinary(std::string& output, const T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+void appendBinary(std::string& output, const std::vector<T>& values) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  appendBinary(output, static_cast<std::uint64_t>(values.size()));
+  output.append(reinterpret_cast<const char*>(values.data()),
+                values.size() * sizeof(T));
+}
+
+inline void appendBinary(std::string& output, std::string_view value) {
+  appendBinary(output, static_cast<std::uint32_t>(value.size()));
+  output.append(value.data(), value.size());
+}
+
+template <typename T>
+bool readBinary(std::string_view& input, T& value) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  if (input.size() < sizeof(value)) {
+    return false;
+  }
+
+  std::memcpy(&value, input.data(), sizeof(value));
+  input.remove_prefix(sizeof(value));
+  return true;
+}
+
+template <typename T>
+bool readBinary(std::string_view& input, std::vector<T>& values) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  std::uint64_t count;
+  if (!readBinary(input, count) || count > input.size() / sizeof(T)) {
+    return false;
+  }
+
+  values.resize(static_cast<size_t>(count));
+  std::memcpy(values.data(), input.data(), values.size() * sizeof(T));
+  input.remove_prefix(values.size() * sizeof(T));
+  return true;
+}
+
+// The value is a view into the input
+inline bool readBinary(std::string_view& input, std::string_view& value) {
+  std::uint32_t size;
+  if (!readBinary(input, size) || size > input.size()) {
+    return false;
+  }
+
+  value = input.substr(0, size);
+  input.remove_prefix(size);
+  return true;
+}
+
+template <typename T>
+void appendAlignedBinary(std::string& output, const T* values, size_t count) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  appendBinary(output, static_cast<std::uint64_t>(count));
+  output.append((alignof(T) - output.size() % alignof(T)) % alignof(T), '\0');
+  output.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+// The values are a view into the input
+template <typename T>
+bool readAlignedBinary(std::string_view& input,
+                       const T*& values,
+                       size_t& count) {
+  static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+  std::uint64_t size;
+  if (!readBinary(input, size)) {
+    return false;
+  }
+
+  auto address = reinterpret_cast<std::uintptr_t>(input.data());
+  auto padding = (alignof(T) - address % alignof(T)) % alignof(T);
+  if (padding > input.size() || size > (input.size() - padding) / sizeof(T)) {
+    return false;
+  }
+
+  input.remove_prefix(padding);
+  values = reinterpret_cast<const T*>(input.data());
+  count = static_cast<size_t>(size);
+  input.remove_prefix(count * sizeof(T));
+  return true;
+}
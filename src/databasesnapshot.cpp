@@ -0,0 +1,274 @@
+#include "databasesnapshot.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <osquery/logger/logger.h>
+
+namespace {
+
+// https://www.sqlite.org/fileformat.html
+const size_t kDatabaseHeaderSize = 100;
+const size_t kDatabasePageSizeOffset = 16;
+const size_t kDatabaseWriteVersionOffset = 18;
+const size_t kDatabaseReadVersionOffset = 19;
+const char kRollbackJournalVersion = 1;
+
+const size_t kWalHeaderSize = 32;
+const size_t kWalFrameHeaderSize = 24;
+
+// The low bit tells whether checksums are computed over big endian words
+const std::uint32_t kWalMagic = 0x377f0682;
+
+// A log that is restarted while it is read is read again, a few times
+const int kMaxReadAttempts = 3;
+
+std::uint32_t readBigEndian32(std::string_view data, size_t offset) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data.data() + offset);
+  return (static_cast<std::uint32_t>(bytes[0]) << 24) |
+         (static_cast<std::uint32_t>(bytes[1]) << 16) |
+         (static_cast<std::uint32_t>(bytes[2]) << 8) |
+         static_cast<std::uint32_t>(bytes[3]);
+}
+
+std::uint32_t readLittleEndian32(std::string_view data, size_t offset) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data.data() + offset);
+  return (static_cast<std::uint32_t>(bytes[3]) << 24) |
+         (static_cast<std::uint32_t>(bytes[2]) << 16) |
+         (static_cast<std::uint32_t>(bytes[1]) << 8) |
+         static_cast<std::uint32_t>(bytes[0]);
+}
+
+// The running checksum of the log, over its header and then every frame
+struct WalChecksum final {
+  bool big_endian{true};
+  std::uint32_t first{0};
+  std::uint32_t second{0};
+
+  void add(std::string_view data) {
+    for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+      auto x0 = big_endian ? readBigEndian32(data, i)
+                           : readLittleEndian32(data, i);
+      auto x1 = big_endian ? readBigEndian32(data, i + 4)
+                           : readLittleEndian32(data, i + 4);
+      first += x0 + second;
+      second += x1 + first;
+    }
+  }
+
+  bool matches(std::string_view data, size_t offset) const {
+    return first == readBigEndian32(data, offset) &&
+           second == readBigEndian32(data, offset + 4);
+  }
+};
+
+// Reads up to max_size bytes of a file. Returns false if it does not exist or
+// cannot be read.
+bool readFile(const std::string& path,
+              std::string& contents,
+              size_t max_size = std::string::npos) {
+  contents.clear();
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOENT) {
+      VLOG(1) << "Failed to open " << path << ": " << std::strerror(errno);
+    }
+
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    contents.reserve(std::min(static_cast<size_t>(file_stat.st_size), max_size));
+  }
+
+  // The file may grow while it is read, so it is read up to its end
+  char buffer[65536];
+  ssize_t count = 0;
+  while (contents.size() < max_size &&
+         (count = read(fd,
+                       buffer,
+                       std::min(sizeof(buffer), max_size - contents.size()))) >
+             0) {
+    contents.append(buffer, static_cast<size_t>(count));
+  }
+
+  close(fd);
+  if (count < 0) {
+    VLOG(1) << "Failed to read " << path;
+    return false;
+  }
+
+  return true;
+}
+
+size_t getDatabasePageSize(std::string_view image) {
+  auto bytes = reinterpret_cast<const unsigned char*>(image.data());
+  auto page_size = (static_cast<size_t>(bytes[kDatabasePageSizeOffset]) << 8) |
+                   bytes[kDatabasePageSizeOffset + 1];
+
+  // 65536 does not fit in two bytes
+  return (page_size == 1) ? 65536 : page_size;
+}
+
+// Applies the transactions committed to the write-ahead log to the database
+// image, the way SQLite recovers a log: frames are valid for as long as their
+// salts match the log header and the running checksum matches, and only the
+// frames up to the last valid commit count. A log SQLite would ignore is
+// ignored.
+void applyWal(std::string_view wal, std::string& image) {
+  if (wal.size() < kWalHeaderSize ||
+      (readBigEndian32(wal, 0) & ~1U) != kWalMagic) {
+    return;
+  }
+
+  auto page_size = static_cast<size_t>(readBigEndian32(wal, 8));
+  if (page_size < 512 || page_size > 65536 ||
+      (page_size & (page_size - 1)) != 0 ||
+      (image.size() >= kDatabaseHeaderSize &&
+       getDatabasePageSize(image) != page_size)) {
+    return;
+  }
+
+  WalChecksum checksum;
+  checksum.big_endian = (readBigEndian32(wal, 0) & 1U) != 0;
+  checksum.add(wal.substr(0, 24));
+  if (!checksum.matches(wal, 24)) {
+    return;
+  }
+
+  auto salt1 = readBigEndian32(wal, 16);
+  auto salt2 = readBigEndian32(wal, 20);
+
+  size_t frame_size = kWalFrameHeaderSize + page_size;
+  size_t committed_end = kWalHeaderSize;
+  std::uint32_t committed_pages = 0;
+  for (size_t offset = kWalHeaderSize; offset + frame_size <= wal.size();
+       offset += frame_size) {
+    if (readBigEndian32(wal, offset) == 0 ||
+        readBigEndian32(wal, offset + 8) != salt1 ||
+        readBigEndian32(wal, offset + 12) != salt2) {
+      break;
+    }
+
+    checksum.add(wal.substr(offset, 8));
+    checksum.add(wal.substr(offset + kWalFrameHeaderSize, page_size));
+    if (!checksum.matches(wal, offset + 16)) {
+      break;
+    }
+
+    // a commit frame holds the size of the database after the transaction
+    auto database_pages = readBigEndian32(wal, offset + 4);
+    if (database_pages != 0) {
+      committed_end = offset + frame_size;
+      committed_pages = database_pages;
+    }
+  }
+
+  if (committed_end == kWalHeaderSize) {
+    return;
+  }
+
+  // Later frames of a page replace earlier ones
+  for (size_t offset = kWalHeaderSize; offset < committed_end;
+       offset += frame_size) {
+    auto page_offset =
+        static_cast<size_t>(readBigEndian32(wal, offset) - 1) * page_size;
+    if (image.size() < page_offset + page_size) {
+      image.resize(page_offset + page_size);
+    }
+
+    image.replace(page_offset,
+                  page_size,
+                  wal.data() + offset + kWalFrameHeaderSize,
+                  page_size);
+  }
+
+  image.resize(static_cast<size_t>(committed_pages) * page_size);
+}
+
+} // namespace
+
+DatabaseSnapshot::~DatabaseSnapshot() {
+  if (db_ != nullptr) {
+    sqlite3_close(db_);
+  }
+}
+
+bool DatabaseSnapshot::open(const std::string& path) {
+  auto wal_path = path + "-wal";
+
+  // The database is read before its log: a checkpoint running meanwhile only
+  // copies frames the log still holds, which are applied over whatever it
+  // copied. A log restarted meanwhile has a new header, and is read again.
+  std::string image;
+  std::string wal;
+  bool consistent = false;
+  for (int attempt = 0; attempt < kMaxReadAttempts && !consistent; ++attempt) {
+    std::string wal_header;
+    auto had_wal = readFile(wal_path, wal_header, kWalHeaderSize);
+
+    if (!readFile(path, image)) {
+      VLOG(1) << "Failed to read the database " << path;
+      return false;
+    }
+
+    auto has_wal = readFile(wal_path, wal);
+    consistent = (had_wal == has_wal) &&
+                 wal.compare(0, kWalHeaderSize, wal_header) == 0;
+  }
+
+  if (!consistent) {
+    VLOG(1) << "The database " << path << " kept changing while it was read";
+    return false;
+  }
+
+  applyWal(wal, image);
+  if (image.size() < kDatabaseHeaderSize) {
+    VLOG(1) << "The database " << path << " is empty or truncated";
+    return false;
+  }
+
+  // An in-memory database has no log of its own to read
+  image[kDatabaseWriteVersionOffset] = kRollbackJournalVersion;
+  image[kDatabaseReadVersionOffset] = kRollbackJournalVersion;
+
+  if (sqlite3_open_v2(":memory:", &db_, SQLITE_OPEN_READWRITE, nullptr) !=
+      SQLITE_OK) {
+    VLOG(1) << "Failed to open an in-memory database: "
+            << sqlite3_errmsg(db_);
+    return false;
+  }
+
+  // SQLite frees the buffer, even if it fails to use it
+  auto size = static_cast<sqlite3_int64>(image.size());
+  auto buffer = static_cast<unsigned char*>(sqlite3_malloc64(image.size()));
+  if (buffer == nullptr) {
+    VLOG(1) << "Failed to allocate a copy of the database " << path;
+    return false;
+  }
+
+  std::memcpy(buffer, image.data(), image.size());
+  auto rc = sqlite3_deserialize(db_,
+                                "main",
+                                buffer,
+                                size,
+                                size,
+                                SQLITE_DESERIALIZE_FREEONCLOSE |
+                                    SQLITE_DESERIALIZE_READONLY);
+  if (rc != SQLITE_OK) {
+    VLOG(1) << "Failed to load a copy of the database " << path << ": "
+            << sqlite3_errmsg(db_);
+    return false;
+  }
+
+  return true;
+}
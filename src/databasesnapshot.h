@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include <sqlite3.h>
+
+// A read-only, in-memory copy of a SQLite database, opened through
+// sqlite3_deserialize. The database file and its write-ahead log are read
+// without taking any lock, and the transactions committed to the log are
+// applied to the copy, so that it holds everything that was committed when it
+// was taken. Nothing is written to disk.
+class DatabaseSnapshot final {
+ public:
+  DatabaseSnapshot() = default;
+  ~DatabaseSnapshot();
+
+  DatabaseSnapshot(const DatabaseSnapshot&) = delete;
+  DatabaseSnapshot& operator=(const DatabaseSnapshot&) = delete;
+
+  // Takes a snapshot of the database at path. Returns false if it cannot be
+  // read, or keeps changing while it is read.
+  bool open(const std::string& path);
+
+  // The connection to the snapshot, valid until it is destroyed
+  sqlite3* get() const {
+    return db_;
+  }
+
+ private:
+  sqlite3* db_{nullptr};
+};
@@ -0,0 +1,745 @@
+#include "decisionstore.h"
+#include "binaryio.h"
+#include "logsource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace {
+// The timestamp is kept on the side when formatting it back from its time
+// would not give the exact same text
+const std::uint16_t kIrregularMillis = 0xFFFF;
+const size_t kTimestampColumn = kLogFieldCount;
+const size_t kColumnCount = kLogFieldCount + 1;
+
+// An empty SHA-256 field is stored as all zeroes, and one kept on the side as
+// all ones. A field that really holds either of them is kept on the side too.
+const std::array<std::uint8_t, 32> kEmptyDigest = {};
+const std::array<std::uint8_t, 32> kIrregularDigest = [] {
+  std::array<std::uint8_t, 32> digest;
+  digest.fill(0xFF);
+  return digest;
+}();
+
+const char kHexDigits[] = "0123456789abcdef";
+
+// Value of every byte as a lowercase hex digit, -1 for the other bytes
+const std::array<std::int8_t, 256> kHexValues = [] {
+  std::array<std::int8_t, 256> values;
+  values.fill(-1);
+  for (std::int8_t value = 0; value < 16; ++value) {
+    values[static_cast<unsigned char>(kHexDigits[value])] = value;
+  }
+
+  return values;
+}();
+
+size_t hashValue(std::string_view value) {
+  return std::hash<std::string_view>()(value);
+}
+
+// Approximate size of a node based hash table, including its buckets
+template <typename Map>
+size_t getMapMemoryUsage(const Map& map) {
+  return map.size() * (sizeof(*map.begin()) + sizeof(void*)) +
+         map.bucket_count() * sizeof(void*);
+}
+
+// Identifies the rows of a summary group: a SHA-256 kept on the side is told
+// apart by its dictionary id
+struct SummaryKey final {
+  std::array<std::uint8_t, 32> sha256;
+  std::uint32_t irregular_sha256;
+  std::uint32_t path;
+
+  bool operator==(const SummaryKey& other) const {
+    return sha256 == other.sha256 &&
+           irregular_sha256 == other.irregular_sha256 && path == other.path;
+  }
+};
+
+struct SummaryKeyHash final {
+  size_t operator()(const SummaryKey& key) const {
+    std::uint64_t prefix;
+    std::memcpy(&prefix, key.sha256.data(), sizeof(prefix));
+    return std::hash<std::uint64_t>()(
+        prefix ^ (static_cast<std::uint64_t>(key.irregular_sha256) << 32 |
+                  key.path));
+  }
+};
+
+// Earliest of two times, 0 standing for an unknown time
+std::int64_t getFirstTime(std::int64_t time, std::int64_t other) {
+  if (time == 0 || other == 0) {
+    return (time == 0) ? other : time;
+  }
+
+  return std::min(time, other);
+}
+
+std::uint64_t getIrregularKey(size_t row, size_t column) {
+  return static_cast<std::uint64_t>(row) * kColumnCount + column;
+}
+
+// Only lowercase hex round-trips through formatSha256
+bool parseSha256(std::string_view text, std::array<std::uint8_t, 32>& digest) {
+  if (text.size() != 64) {
+    return false;
+  }
+
+  // Invalid digits are only checked for at the end, hex digits are too
+  // random for a branch on every one of them to be predicted
+  int invalid = 0;
+  for (size_t i = 0; i < digest.size(); ++i) {
+    int high = kHexValues[static_cast<unsigned char>(text[2 * i])];
+    int low = kHexValues[static_cast<unsigned char>(text[2 * i + 1])];
+    invalid |= high | low;
+    digest[i] = static_cast<std::uint8_t>((high & 0xF) << 4 | (low & 0xF));
+  }
+
+  return invalid >= 0;
+}
+
+void formatSha256(const std::array<std::uint8_t, 32>& digest,
+                  std::string& text) {
+  text.resize(64);
+  for (size_t i = 0; i < digest.size(); ++i) {
+    text[2 * i] = kHexDigits[digest[i] >> 4];
+    text[2 * i + 1] = kHexDigits[digest[i] & 0xF];
+  }
+}
+
+// Gets the milliseconds of a timestamp, if the timestamp can be formatted
+// back from them and its time
+bool getTimestampMillis(std::string_view timestamp,
+                        std::int64_t time,
+                        std::uint16_t& millis) {
+  if (timestamp.size() != 24) {
+    return false;
+  }
+
+  millis = 0;
+  for (size_t i = 20; i < 23; ++i) {
+    if (timestamp[i] < '0' || timestamp[i] > '9') {
+      return false;
+    }
+
+    millis = static_cast<std::uint16_t>(millis * 10 + (timestamp[i] - '0'));
+  }
+
+  std::string formatted;
+  return formatLogTimestamp(time, millis, formatted) && formatted == timestamp;
+}
+
+template <typename T>
+void appendColumn(std::string& output, const StoreColumn<T>& column) {
+  appendAlignedBinary(output, column.begin(), column.size());
+}
+
+template <typename T>
+bool readColumn(std::string_view& input,
+                bool in_place,
+                StoreColumn<T>& column) {
+  const T* values;
+  size_t count;
+  if (!readAlignedBinary(input, values, count)) {
+    return false;
+  }
+
+  if (in_place) {
+    column.borrow(values, count);
+  } else {
+    column.assign(values, count);
+  }
+
+  return true;
+}
+} // namespace
+
+void DecisionStore::add(const LogEntryView& entry) {
+  auto row = times_.size();
+
+  std::uint16_t millis;
+  if (!getTimestampMillis(entry.timestamp, entry.time, millis)) {
+    millis = kIrregularMillis;
+    addIrregularValue(row, kTimestampColumn, entry.timestamp);
+  }
+
+  times_.push_back(entry.time);
+  millis_.push_back(millis);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    const auto& value = entry.fields[i];
+    if (kLogFields[i].type != LogFieldDescriptor::Type::Sha256) {
+      text_columns_[i].push_back(dictionary_.intern(value));
+      continue;
+    }
+
+    Sha256Digest digest = kEmptyDigest;
+    if (!value.empty() &&
+        (!parseSha256(value, digest) || digest == kEmptyDigest ||
+         digest == kIrregularDigest)) {
+      digest = kIrregularDigest;
+      addIrregularValue(row, i, value);
+    }
+
+    sha256_columns_[i].push_back(digest);
+  }
+
+  min_time_ = std::min(min_time_, entry.time);
+  max_time_ = std::max(max_time_, entry.time);
+  resetIndexes();
+}
+
+void DecisionStore::append(DecisionStore&& other) {
+  if (times_.empty()) {
+    *this = std::move(other);
+  } else {
+    append(static_cast<const DecisionStore&>(other));
+  }
+
+  other = DecisionStore();
+}
+
+void DecisionStore::append(const DecisionStore& other) {
+  // Both stores have their own dictionary
+  std::vector<std::uint32_t> ids(other.dictionary_.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i] = dictionary_.intern(
+        other.dictionary_.get(static_cast<std::uint32_t>(i)));
+  }
+
+  auto row_offset = times_.size();
+  times_.append(other.times_);
+  millis_.append(other.millis_);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    auto& column = text_columns_[i];
+    for (auto id : other.text_columns_[i]) {
+      column.push_back(ids[id]);
+    }
+
+    sha256_columns_[i].append(other.sha256_columns_[i]);
+  }
+
+  for (const auto& irregular_value : other.irregular_values_) {
+    auto row = irregular_value.first / kColumnCount + row_offset;
+    auto column = irregular_value.first % kColumnCount;
+    irregular_values_.emplace(getIrregularKey(row, column),
+                              ids[irregular_value.second]);
+  }
+
+  min_time_ = std::min(min_time_, other.min_time_);
+  max_time_ = std::max(max_time_, other.max_time_);
+  resetIndexes();
+}
+
+size_t DecisionStore::size() const {
+  return times_.size();
+}
+
+std::int64_t DecisionStore::minTime() const {
+  return min_time_;
+}
+
+std::int64_t DecisionStore::maxTime() const {
+  return max_time_;
+}
+
+const StoreColumn<std::int64_t>& DecisionStore::times() const {
+  return times_;
+}
+
+size_t DecisionStore::memoryUsage() const {
+  size_t usage = sizeof(*this) + dictionary_.memoryUsage() +
+                 times_.memoryUsage() + millis_.memoryUsage() +
+                 getMapMemoryUsage(irregular_values_);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    usage += text_columns_[i].memoryUsage() + sha256_columns_[i].memoryUsage();
+  }
+
+  auto summary = std::atomic_load(&summary_);
+  if (summary) {
+    usage += summary->capacity() * sizeof(SummaryGroup);
+  }
+
+  auto indexes = std::atomic_load(&indexes_);
+  if (!indexes) {
+    return usage;
+  }
+
+  for (const auto* index : {&indexes->sha256, &indexes->path}) {
+    usage += getMapMemoryUsage(*index);
+    for (const auto& rows : *index) {
+      usage += rows.second.capacity() * sizeof(rows.second[0]);
+    }
+  }
+
+  return usage;
+}
+
+DecisionStore DecisionStore::copySince(std::int64_t time) const {
+  DecisionStore copy;
+  for (size_t row = 0; row < times_.size(); ++row) {
+    if (times_[row] >= time) {
+      copy.copyRow(*this, row);
+    }
+  }
+
+  // Give back what the columns over-allocated while growing
+  copy.times_.shrink_to_fit();
+  copy.millis_.shrink_to_fit();
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    copy.text_columns_[i].shrink_to_fit();
+    copy.sha256_columns_[i].shrink_to_fit();
+  }
+
+  return copy;
+}
+
+void DecisionStore::serialize(std::string& output) const {
+  appendBinary(output, static_cast<std::uint32_t>(dictionary_.size()));
+  for (std::uint32_t id = 0; id < dictionary_.size(); ++id) {
+    appendBinary(output, dictionary_.get(id));
+  }
+
+  appendColumn(output, times_);
+  appendColumn(output, millis_);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    if (kLogFields[i].type == LogFieldDescriptor::Type::Sha256) {
+      appendColumn(output, sha256_columns_[i]);
+    } else {
+      appendColumn(output, text_columns_[i]);
+    }
+  }
+
+  appendBinary(output, static_cast<std::uint64_t>(irregular_values_.size()));
+  for (const auto& irregular_value : irregular_values_) {
+    appendBinary(output, irregular_value.first);
+    appendBinary(output, irregular_value.second);
+  }
+}
+
+bool DecisionStore::deserialize(std::string_view& input,
+                                const std::shared_ptr<const void>& mapping) {
+  DecisionStore store;
+  store.mapping_ = mapping;
+  auto in_place = (mapping != nullptr);
+
+  std::uint32_t dictionary_size;
+  if (!readBinary(input, dictionary_size)) {
+    return false;
+  }
+
+  for (std::uint32_t id = 0; id < dictionary_size; ++id) {
+    std::string_view value;
+    if (!readBinary(input, value) ||
+        (in_place ? store.dictionary_.internInPlace(value)
+                  : store.dictionary_.intern(value)) != id) {
+      return false;
+    }
+  }
+
+  if (!readColumn(input, in_place, store.times_) ||
+      !readColumn(input, in_place, store.millis_) ||
+      store.millis_.size() != store.times_.size()) {
+    return false;
+  }
+
+  auto row_count = store.times_.size();
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    if (kLogFields[i].type == LogFieldDescriptor::Type::Sha256) {
+      if (!readColumn(input, in_place, store.sha256_columns_[i]) ||
+          store.sha256_columns_[i].size() != row_count) {
+        return false;
+      }
+
+      continue;
+    }
+
+    auto& column = store.text_columns_[i];
+    if (!readColumn(input, in_place, column) || column.size() != row_count ||
+        std::any_of(column.begin(), column.end(), [&](std::uint32_t id) {
+          return id >= dictionary_size;
+        })) {
+      return false;
+    }
+  }
+
+  std::uint64_t irregular_count;
+  if (!readBinary(input, irregular_count)) {
+    return false;
+  }
+
+  for (std::uint64_t i = 0; i < irregular_count; ++i) {
+    std::uint64_t key;
+    std::uint32_t id;
+    if (!readBinary(input, key) || !readBinary(input, id) ||
+        key / kColumnCount >= row_count || id >= dictionary_size) {
+      return false;
+    }
+
+    store.irregular_values_.emplace(key, id);
+  }
+
+  for (auto time : store.times_) {
+    store.min_time_ = std::min(store.min_time_, time);
+    store.max_time_ = std::max(store.max_time_, time);
+  }
+
+  *this = std::move(store);
+  return true;
+}
+
+void DecisionStore::collect(LogEntries& response,
+                            const DecisionFilter& filter) const {
+  if (times_.empty() || filter.max_time < min_time_ ||
+      filter.min_time > max_time_) {
+    return;
+  }
+
+  auto filter_values = getFilterValues(filter);
+  if (filter_values.excludesAll()) {
+    return;
+  }
+
+  std::vector<std::int8_t> path_matches;
+  if (filter.sha256s.empty() && filter.paths.empty()) {
+    for (size_t row = 0; row < times_.size(); ++row) {
+      if (matchesFilter(row, filter, filter_values, path_matches)) {
+        response.push_back(makeEntry(row, filter.fields));
+      }
+    }
+
+    return;
+  }
+
+  // Look up the candidates through one index, the filter checks the rest.
+  // Hash collisions are weeded out the same way.
+  const auto& indexes = getIndexes();
+  const auto& index = filter.sha256s.empty() ? indexes.path : indexes.sha256;
+  const auto& values = filter.sha256s.empty() ? filter.paths : filter.sha256s;
+
+  std::vector<std::uint32_t> rows;
+  for (const auto& value : values) {
+    auto index_it = index.find(hashValue(value));
+    if (index_it != index.end()) {
+      rows.insert(rows.end(), index_it->second.begin(), index_it->second.end());
+    }
+  }
+
+  std::sort(rows.begin(), rows.end());
+  rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+  for (auto row : rows) {
+    if (matchesFilter(row, filter, filter_values, path_matches)) {
+      response.push_back(makeEntry(row, filter.fields));
+    }
+  }
+}
+
+void DecisionStore::forEachSha256Since(
+    std::int64_t time,
+    const std::function<void(std::string_view, std::int64_t)>& callback)
+    const {
+  auto row = times_.size();
+  while (row > 0 && times_[row - 1] >= time) {
+    --row;
+  }
+
+  std::string scratch;
+  for (; row < times_.size(); ++row) {
+    callback(getValue(row, kLogFieldSha256, scratch), times_[row]);
+  }
+}
+
+void DecisionStore::summarize(DecisionSummaries& summaries,
+                              const DecisionFilter& filter) const {
+  auto filter_values = getFilterValues(filter);
+  if (filter_values.excludesAll()) {
+    return;
+  }
+
+  std::string sha256_scratch;
+  std::string path_scratch;
+  std::string key;
+  for (const auto& group : getSummary()) {
+    if (!matchesValues(group.first_row, filter_values)) {
+      continue;
+    }
+
+    auto sha256 = getValue(group.first_row, kLogFieldSha256, sha256_scratch);
+    auto path = getValue(group.first_row, kLogFieldPath, path_scratch);
+    key.assign(sha256);
+    key.push_back('\0');
+    key.append(path);
+
+    auto& summary = summaries[key];
+    if (summary.count == 0) {
+      summary.sha256 = sha256;
+      summary.path = path;
+    }
+
+    if (summary.count == 0 || group.last_time > summary.last_seen) {
+      summary.last_seen = group.last_time;
+      summary.reason = dictionary_.get(
+          text_columns_[kLogFieldReason][group.last_row]);
+    }
+
+    summary.first_seen = (summary.count == 0)
+                             ? group.first_time
+                             : getFirstTime(summary.first_seen, group.first_time);
+    summary.count += group.count;
+  }
+}
+
+std::string_view DecisionStore::getValue(size_t row,
+                                         size_t column,
+                                         std::string& scratch) const {
+  if (column == kTimestampColumn) {
+    if (millis_[row] != kIrregularMillis) {
+      formatLogTimestamp(times_[row], millis_[row], scratch);
+      return scratch;
+    }
+
+  } else if (kLogFields[column].type != LogFieldDescriptor::Type::Sha256) {
+    return dictionary_.get(text_columns_[column][row]);
+
+  } else {
+    const auto& digest = sha256_columns_[column][row];
+    if (digest == kEmptyDigest) {
+      return {};
+    }
+
+    if (digest != kIrregularDigest) {
+      formatSha256(digest, scratch);
+      return scratch;
+    }
+  }
+
+  return dictionary_.get(irregular_values_.at(getIrregularKey(row, column)));
+}
+
+void DecisionStore::addIrregularValue(size_t row,
+                                      size_t column,
+                                      std::string_view value) {
+  irregular_values_[getIrregularKey(row, column)] = dictionary_.intern(value);
+}
+
+void DecisionStore::copyRow(const DecisionStore& source, size_t row) {
+  auto new_row = times_.size();
+  times_.push_back(source.times_[row]);
+  millis_.push_back(source.millis_[row]);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    if (kLogFields[i].type == LogFieldDescriptor::Type::Sha256) {
+      sha256_columns_[i].push_back(source.sha256_columns_[i][row]);
+    } else {
+      text_columns_[i].push_back(dictionary_.intern(
+          source.dictionary_.get(source.text_columns_[i][row])));
+    }
+  }
+
+  if (!source.irregular_values_.empty()) {
+    for (size_t column = 0; column < kColumnCount; ++column) {
+      auto value_it =
+          source.irregular_values_.find(getIrregularKey(row, column));
+      if (value_it != source.irregular_values_.end()) {
+        addIrregularValue(
+            new_row, column, source.dictionary_.get(value_it->second));
+      }
+    }
+  }
+
+  min_time_ = std::min(min_time_, times_.back());
+  max_time_ = std::max(max_time_, times_.back());
+}
+
+DecisionStore::FilterValues DecisionStore::getFilterValues(
+    const DecisionFilter& filter) const {
+  FilterValues values;
+  values.has_sha256s = !filter.sha256s.empty();
+  values.has_paths = !filter.paths.empty();
+
+  // Classified the way add() does, so that a value is looked up where add()
+  // would have stored it
+  for (const auto& sha256 : filter.sha256s) {
+    Sha256Digest digest;
+    std::uint32_t id;
+    if (sha256.empty()) {
+      values.empty_sha256 = true;
+    } else if (parseSha256(sha256, digest) && digest != kEmptyDigest &&
+               digest != kIrregularDigest) {
+      values.sha256s.push_back(digest);
+    } else if (dictionary_.find(sha256, id)) {
+      values.irregular_sha256s.push_back(id);
+    }
+  }
+
+  for (const auto& path : filter.paths) {
+    std::uint32_t id;
+    if (dictionary_.find(path, id)) {
+      values.paths.push_back(id);
+    }
+  }
+
+  std::sort(values.sha256s.begin(), values.sha256s.end());
+  std::sort(values.irregular_sha256s.begin(), values.irregular_sha256s.end());
+  std::sort(values.paths.begin(), values.paths.end());
+  return values;
+}
+
+bool DecisionStore::matchesValues(size_t row,
+                                  const FilterValues& values) const {
+  if (values.has_sha256s) {
+    const auto& digest = sha256_columns_[kLogFieldSha256][row];
+    bool found;
+    if (digest == kEmptyDigest) {
+      found = values.empty_sha256;
+    } else if (digest == kIrregularDigest) {
+      found = std::binary_search(
+          values.irregular_sha256s.begin(),
+          values.irregular_sha256s.end(),
+          irregular_values_.at(getIrregularKey(row, kLogFieldSha256)));
+    } else {
+      found = std::binary_search(
+          values.sha256s.begin(), values.sha256s.end(), digest);
+    }
+
+    if (!found) {
+      return false;
+    }
+  }
+
+  return !values.has_paths ||
+         std::binary_search(values.paths.begin(),
+                            values.paths.end(),
+                            text_columns_[kLogFieldPath][row]);
+}
+
+bool DecisionStore::matchesFilter(size_t row,
+                                  const DecisionFilter& filter,
+                                  const FilterValues& values,
+                                  std::vector<std::int8_t>& path_matches) const {
+  if (times_[row] < filter.min_time || times_[row] > filter.max_time) {
+    return false;
+  }
+
+  if (filter.path_matcher) {
+    auto path = text_columns_[kLogFieldPath][row];
+    if (path_matches.empty()) {
+      path_matches.resize(dictionary_.size());
+    }
+
+    if (path_matches[path] == 0) {
+      path_matches[path] =
+          filter.path_matcher->matches(dictionary_.get(path)) ? 1 : -1;
+    }
+
+    if (path_matches[path] < 0) {
+      return false;
+    }
+  }
+
+  return matchesValues(row, values);
+}
+
+// Copies only the fields the query asked for
+LogEntry DecisionStore::makeEntry(size_t row, const LogFieldSet& fields) const {
+  std::string scratch;
+
+  LogEntry entry;
+  entry.time = times_[row];
+  entry.timestamp = getValue(row, kTimestampColumn, scratch);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    if (fields.test(i)) {
+      entry.fields[i] = getValue(row, i, scratch);
+    }
+  }
+
+  return entry;
+}
+
+const DecisionStore::Indexes& DecisionStore::getIndexes() const {
+  auto indexes = std::atomic_load(&indexes_);
+  if (indexes) {
+    return *indexes;
+  }
+
+  std::lock_guard<std::mutex> lock(*index_mutex_);
+  if (indexes_) {
+    return *indexes_;
+  }
+
+  auto new_indexes = std::make_shared<Indexes>();
+  std::string scratch;
+  for (std::uint32_t row = 0; row < times_.size(); ++row) {
+    new_indexes->sha256[hashValue(getValue(row, kLogFieldSha256, scratch))]
+        .push_back(row);
+    new_indexes->path[hashValue(getValue(row, kLogFieldPath, scratch))]
+        .push_back(row);
+  }
+
+  std::atomic_store(&indexes_,
+                    std::shared_ptr<const Indexes>(std::move(new_indexes)));
+  return *indexes_;
+}
+
+const DecisionStore::Summary& DecisionStore::getSummary() const {
+  auto summary = std::atomic_load(&summary_);
+  if (summary) {
+    return *summary;
+  }
+
+  std::lock_guard<std::mutex> lock(*index_mutex_);
+  if (summary_) {
+    return *summary_;
+  }
+
+  auto new_summary = std::make_shared<Summary>();
+  std::unordered_map<SummaryKey, std::uint32_t, SummaryKeyHash> groups;
+  for (std::uint32_t row = 0; row < times_.size(); ++row) {
+    SummaryKey key;
+    key.sha256 = sha256_columns_[kLogFieldSha256][row];
+    key.irregular_sha256 =
+        (key.sha256 == kIrregularDigest)
+            ? irregular_values_.at(getIrregularKey(row, kLogFieldSha256))
+            : std::numeric_limits<std::uint32_t>::max();
+    key.path = text_columns_[kLogFieldPath][row];
+
+    auto time = times_[row];
+    auto group_it = groups.find(key);
+    if (group_it == groups.end()) {
+      groups.emplace(key, static_cast<std::uint32_t>(new_summary->size()));
+      new_summary->push_back({row, row, 1, time, time});
+      continue;
+    }
+
+    auto& group = (*new_summary)[group_it->second];
+    ++group.count;
+    group.first_time = getFirstTime(group.first_time, time);
+    if (time >= group.last_time) {
+      group.last_time = time;
+      group.last_row = row;
+    }
+  }
+
+  new_summary->shrink_to_fit();
+  std::atomic_store(&summary_,
+                    std::shared_ptr<const Summary>(std::move(new_summary)));
+  return *summary_;
+}
+
+void DecisionStore::resetIndexes() {
+  if (indexes_) {
+    indexes_.reset();
+  }
+
+  if (summary_) {
+    summary_.reset();
+  }
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "santa.h"
+#include "stringdictionary.h"
+
+// The values of one column of a store. They are either owned, or read in
+// place from a mapped archive index that the store keeps alive; borrowed
+// values are copied out the first time the column is modified.
+template <typename T>
+class StoreColumn final {
+ public:
+  size_t size() const {
+    return (borrowed_ != nullptr) ? borrowed_size_ : values_.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const T* begin() const {
+    return (borrowed_ != nullptr) ? borrowed_ : values_.data();
+  }
+
+  const T* end() const {
+    return begin() + size();
+  }
+
+  const T& operator[](size_t index) const {
+    return begin()[index];
+  }
+
+  const T& back() const {
+    return end()[-1];
+  }
+
+  void push_back(const T& value) {
+    own();
+    values_.push_back(value);
+  }
+
+  void append(const StoreColumn& other) {
+    own();
+    values_.insert(values_.end(), other.begin(), other.end());
+  }
+
+  // Copies the values
+  void assign(const T* values, size_t count) {
+    borrowed_ = nullptr;
+    borrowed_size_ = 0;
+    values_.assign(values, values + count);
+  }
+
+  // Points the column at values that outlive it
+  void borrow(const T* values, size_t count) {
+    std::vector<T>().swap(values_);
+    borrowed_ = values;
+    borrowed_size_ = count;
+  }
+
+  void shrink_to_fit() {
+    values_.shrink_to_fit();
+  }
+
+  // Bytes taken by the values, borrowed ones included
+  size_t memoryUsage() const {
+    return (borrowed_ != nullptr) ? borrowed_size_ * sizeof(T)
+                                  : values_.capacity() * sizeof(T);
+  }
+
+ private:
+  void own() {
+    if (borrowed_ != nullptr) {
+      values_.assign(begin(), end());
+      borrowed_ = nullptr;
+      borrowed_size_ = 0;
+    }
+  }
+
+  std::vector<T> values_;
+  const T* borrowed_{nullptr};
+  size_t borrowed_size_{0};
+};
+
+// The parsed events of one type read from one log file, in log order.
+//
+// Entries are kept column by column. Text fields are interned in a dictionary
+// shared by all columns, so each row costs a 4 byte id per field; SHA-256
+// fields are kept as 32 binary bytes and the timestamp as its time plus
+// milliseconds. Values that do not have the expected form are interned
+// instead, on the side.
+//
+// Time range queries skip stores that cannot overlap them, and point lookups
+// on sha256 and path go through hash indexes that are built on the first
+// constrained query. Likewise, the entries are grouped by sha256 and path on
+// the first summary query, and later ones only merge the groups.
+//
+// A store is filled by a single thread. Once it is shared it must not be
+// modified anymore, and then any number of threads may collect from it.
+class DecisionStore final {
+ public:
+  void add(const LogEntryView& entry);
+
+  // Moves or copies every entry of other to the end of this store
+  void append(DecisionStore&& other);
+  void append(const DecisionStore& other);
+
+  size_t size() const;
+
+  // Times of the oldest and newest entries. Only meaningful when the store is
+  // not empty.
+  std::int64_t minTime() const;
+  std::int64_t maxTime() const;
+
+  // Entry times, in store order
+  const StoreColumn<std::int64_t>& times() const;
+
+  // Approximate heap and object size of the store, indexes included
+  size_t memoryUsage() const;
+
+  // Returns a compact copy of the entries that are not older than time
+  DecisionStore copySince(std::int64_t time) const;
+
+  // Appends the store to output in a compact binary form. Indexes are not
+  // written; they are rebuilt when needed.
+  void serialize(std::string& output) const;
+
+  // Reads a store written by serialize from the front of input. When input
+  // lies in mapping, the columns and strings are read in place and the store
+  // keeps the mapping alive; otherwise they are copied.
+  bool deserialize(std::string_view& input,
+                   const std::shared_ptr<const void>& mapping = nullptr);
+
+  // Appends the entries matching the filter to response, in store order
+  void collect(LogEntries& response, const DecisionFilter& filter) const;
+
+  // Calls callback(sha256, time) for the entries at the end of the store that
+  // were logged at or after time, in store order
+  void forEachSha256Since(
+      std::int64_t time,
+      const std::function<void(std::string_view, std::int64_t)>& callback)
+      const;
+
+  // Merges the entries into summaries. Only the sha256 and path sets of the
+  // filter apply. Of two entries with the same time, the one already in
+  // summaries gives the reason, so stores are merged newest first.
+  void summarize(DecisionSummaries& summaries,
+                 const DecisionFilter& filter) const;
+
+ private:
+  using Sha256Digest = std::array<std::uint8_t, 32>;
+
+  // Maps the hash of a value to the rows holding it
+  using Index = std::unordered_map<size_t, std::vector<std::uint32_t>>;
+
+  struct Indexes final {
+    Index sha256;
+    Index path;
+  };
+
+  // The rows sharing a sha256 and a path
+  struct SummaryGroup final {
+    std::uint32_t first_row; // reads back the sha256 and path
+    std::uint32_t last_row; // the latest entry, which gives the reason
+    std::uint64_t count;
+    std::int64_t first_time;
+    std::int64_t last_time;
+  };
+
+  using Summary = std::vector<SummaryGroup>;
+
+  // The sha256 and path sets of a filter in the form the columns hold them:
+  // digests, and dictionary ids for the values kept as text. They are
+  // converted once per query, so that rows are compared without formatting
+  // their values. Values this store does not hold are left out.
+  struct FilterValues final {
+    bool has_sha256s{false};
+    bool has_paths{false};
+    bool empty_sha256{false};
+    std::vector<Sha256Digest> sha256s; // sorted
+    std::vector<std::uint32_t> irregular_sha256s; // sorted
+    std::vector<std::uint32_t> paths; // sorted
+
+    // No row can match
+    bool excludesAll() const {
+      return (has_sha256s && !empty_sha256 && sha256s.empty() &&
+              irregular_sha256s.empty()) ||
+             (has_paths && paths.empty());
+    }
+  };
+
+  // Reads a field back as text; kLogFieldCount reads the timestamp. Values
+  // that have to be formatted are written to scratch.
+  std::string_view getValue(size_t row,
+                            size_t column,
+                            std::string& scratch) const;
+
+  void addIrregularValue(size_t row, size_t column, std::string_view value);
+
+  // Appends a row of another store
+  void copyRow(const DecisionStore& source, size_t row);
+
+  FilterValues getFilterValues(const DecisionFilter& filter) const;
+
+  // Checks the sha256 and path of a row against the converted filter sets
+  bool matchesValues(size_t row, const FilterValues& values) const;
+
+  // Path patterns are checked once per distinct path, and the outcome kept
+  // in path_matches by dictionary id: 0 unknown, 1 matching, -1 not
+  bool matchesFilter(size_t row,
+                     const DecisionFilter& filter,
+                     const FilterValues& values,
+                     std::vector<std::int8_t>& path_matches) const;
+  LogEntry makeEntry(size_t row, const LogFieldSet& fields) const;
+
+  // Builds the indexes on first use. Safe to call from concurrent readers.
+  const Indexes& getIndexes() const;
+
+  // Groups the rows on first use. Safe to call from concurrent readers.
+  const Summary& getSummary() const;
+
+  // Forgets the indexes and the summary after a modification
+  void resetIndexes();
+
+  StringDictionary dictionary_;
+
+  StoreColumn<std::int64_t> times_;
+  StoreColumn<std::uint16_t> millis_;
+  std::array<StoreColumn<std::uint32_t>, kLogFieldCount> text_columns_;
+  std::array<StoreColumn<Sha256Digest>, kLogFieldCount> sha256_columns_;
+
+  // The mapped archive index that borrowed columns and strings point into
+  std::shared_ptr<const void> mapping_;
+
+  // Dictionary ids of the values kept on the side, by row and column
+  std::unordered_map<std::uint64_t, std::uint32_t> irregular_values_;
+
+  std::int64_t min_time_{std::numeric_limits<std::int64_t>::max()};
+  std::int64_t max_time_{std::numeric_limits<std::int64_t>::min()};
+
+  // Only ever replaced under the mutex, and read through atomic loads
+  mutable std::shared_ptr<const Indexes> indexes_;
+  mutable std::shared_ptr<const Summary> summary_;
+  mutable std::unique_ptr<std::mutex> index_mutex_{new std::mutex};
+};
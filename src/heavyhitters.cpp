@@ -0,0 +1,155 @@
+#include "heavyhitters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace {
+
+std::uint64_t mixHash(std::uint64_t value) {
+  // splitmix64 finalizer
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+// Orders the heap by lowest estimate first
+bool isHigherEstimate(const std::pair<std::uint64_t, std::string>& first,
+                      const std::pair<std::uint64_t, std::string>& second) {
+  return first.first > second.first;
+}
+
+} // namespace
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth)
+    : width_(std::max<size_t>(width, 1)),
+      depth_(std::max<size_t>(depth, 1)),
+      counters_(width_ * depth_) {}
+
+void CountMinSketch::add(std::string_view key) {
+  for (size_t row = 0; row < depth_; ++row) {
+    ++counters_[getCounter(key, row)];
+  }
+
+  ++total_;
+}
+
+std::uint64_t CountMinSketch::estimate(std::string_view key) const {
+  auto estimate = std::numeric_limits<std::uint64_t>::max();
+  for (size_t row = 0; row < depth_; ++row) {
+    estimate = std::min(estimate, counters_[getCounter(key, row)]);
+  }
+
+  return estimate;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+  if (other.width_ != width_ || other.depth_ != depth_) {
+    return;
+  }
+
+  for (size_t i = 0; i < counters_.size(); ++i) {
+    counters_[i] += other.counters_[i];
+  }
+
+  total_ += other.total_;
+}
+
+std::uint64_t CountMinSketch::total() const {
+  return total_;
+}
+
+double CountMinSketch::errorRate() const {
+  return std::exp(1.0) / static_cast<double>(width_);
+}
+
+double CountMinSketch::confidence() const {
+  return 1.0 - std::exp(-static_cast<double>(depth_));
+}
+
+size_t CountMinSketch::memoryUsage() const {
+  return sizeof(*this) + counters_.capacity() * sizeof(counters_[0]);
+}
+
+size_t CountMinSketch::getCounter(std::string_view key, size_t row) const {
+  // Rows are indexed by h1 + row * h2, which is as good as independent
+  // hash functions for this purpose
+  auto first_hash = mixHash(std::hash<std::string_view>()(key));
+  auto second_hash = mixHash(first_hash) | 1;
+  return row * width_ + (first_hash + row * second_hash) % width_;
+}
+
+HeavyHitters::HeavyHitters(size_t capacity, size_t width, size_t depth)
+    : capacity_(std::max<size_t>(capacity, 1)), sketch_(width, depth) {}
+
+void HeavyHitters::add(std::string_view key) {
+  sketch_.add(key);
+  auto estimate = sketch_.estimate(key);
+
+  std::string held_key(key);
+  auto estimate_it = estimates_.find(held_key);
+  if (estimate_it != estimates_.end()) {
+    estimate_it->second = estimate;
+    return;
+  }
+
+  if (estimates_.size() < capacity_) {
+    estimates_.emplace(held_key, estimate);
+    heap_.emplace_back(estimate, held_key);
+    std::push_heap(heap_.begin(), heap_.end(), isHigherEstimate);
+    return;
+  }
+
+  // Bring the top of the heap up to date until it holds the lowest estimate
+  for (;;) {
+    auto& top = heap_.front();
+    auto latest_estimate = estimates_[top.second];
+    if (latest_estimate == top.first) {
+      break;
+    }
+
+    std::pop_heap(heap_.begin(), heap_.end(), isHigherEstimate);
+    heap_.back().first = latest_estimate;
+    std::push_heap(heap_.begin(), heap_.end(), isHigherEstimate);
+  }
+
+  if (estimate <= heap_.front().first) {
+    return;
+  }
+
+  std::pop_heap(heap_.begin(), heap_.end(), isHigherEstimate);
+  estimates_.erase(heap_.back().second);
+  heap_.back() = {estimate, held_key};
+  std::push_heap(heap_.begin(), heap_.end(), isHigherEstimate);
+  estimates_.emplace(std::move(held_key), estimate);
+}
+
+const CountMinSketch& HeavyHitters::sketch() const {
+  return sketch_;
+}
+
+std::vector<std::string> HeavyHitters::keys() const {
+  std::vector<std::string> keys;
+  keys.reserve(estimates_.size());
+  for (const auto& estimate : estimates_) {
+    keys.push_back(estimate.first);
+  }
+
+  return keys;
+}
+
+size_t HeavyHitters::memoryUsage() const {
+  size_t usage = sizeof(*this) - sizeof(sketch_) + sketch_.memoryUsage() +
+                 heap_.capacity() * sizeof(heap_[0]) +
+                 estimates_.bucket_count() * sizeof(void*);
+
+  for (const auto& estimate : estimates_) {
+    usage += sizeof(estimate) + sizeof(void*) + 2 * estimate.first.capacity();
+  }
+
+  return usage;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Frequency estimates of a stream of keys in fixed memory. An estimate is
+// never below the true count, and with probability confidence() it is above
+// it by at most errorRate() times the total count.
+class CountMinSketch final {
+ public:
+  CountMinSketch(size_t width, size_t depth);
+
+  void add(std::string_view key);
+
+  std::uint64_t estimate(std::string_view key) const;
+
+  // Adds the counts of a sketch of the same dimensions
+  void merge(const CountMinSketch& other);
+
+  // Number of keys added
+  std::uint64_t total() const;
+
+  double errorRate() const;
+  double confidence() const;
+
+  size_t memoryUsage() const;
+
+ private:
+  // The counter of a key in a row
+  size_t getCounter(std::string_view key, size_t row) const;
+
+  size_t width_;
+  size_t depth_;
+  std::vector<std::uint64_t> counters_;
+  std::uint64_t total_{0};
+};
+
+// The most frequent keys of a stream in fixed memory: a count-min sketch of
+// every key, and a min-heap of the capacity keys with the highest estimates
+class HeavyHitters final {
+ public:
+  HeavyHitters(size_t capacity, size_t width, size_t depth);
+
+  void add(std::string_view key);
+
+  const CountMinSketch& sketch() const;
+
+  // The keys currently held, in no particular order
+  std::vector<std::string> keys() const;
+
+  size_t memoryUsage() const;
+
+ private:
+  size_t capacity_;
+  CountMinSketch sketch_;
+
+  // Estimates of the keys held. The heap only gets the latest estimate of
+  // its top when it matters, so its other entries may be lower than these.
+  std::unordered_map<std::string, std::uint64_t> estimates_;
+  std::vector<std::pair<std::uint64_t, std::string>> heap_;
+};
@@ -0,0 +1,217 @@
+#include "logscanner.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include <osquery/logger/logger.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+// The vector kernels look for the marker's first and last characters at the
+// right distance from each other, and only compare the full marker at the
+// (rare) positions where both match.
+using FindMarkerFunction = size_t (*)(std::string_view buffer,
+                                      size_t pos,
+                                      std::string_view marker);
+
+bool markerAt(std::string_view buffer, size_t pos, std::string_view marker) {
+  return std::memcmp(buffer.data() + pos + 1,
+                     marker.data() + 1,
+                     marker.size() - 2) == 0;
+}
+
+size_t findMarkerPortable(std::string_view buffer,
+                          size_t pos,
+                          std::string_view marker) {
+  return buffer.find(marker, pos);
+}
+
+#if defined(__x86_64__)
+size_t findMarkerSSE2(std::string_view buffer,
+                      size_t pos,
+                      std::string_view marker) {
+  const size_t last_offset = marker.size() - 1;
+  const auto first = _mm_set1_epi8(marker.front());
+  const auto last = _mm_set1_epi8(marker.back());
+  const char* data = buffer.data();
+
+  for (; pos + last_offset + 16 <= buffer.size(); pos += 16) {
+    auto block_first =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    auto block_last = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(data + pos + last_offset));
+
+    auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+
+    while (mask != 0) {
+      size_t candidate = pos + __builtin_ctz(mask);
+      if (markerAt(buffer, candidate, marker)) {
+        return candidate;
+      }
+
+      mask &= mask - 1;
+    }
+  }
+
+  return findMarkerPortable(buffer, pos, marker);
+}
+
+__attribute__((target("avx2"))) size_t findMarkerAVX2(std::string_view buffer,
+                                                      size_t pos,
+                                                      std::string_view marker) {
+  const size_t last_offset = marker.size() - 1;
+  const auto first = _mm256_set1_epi8(marker.front());
+  const auto last = _mm256_set1_epi8(marker.back());
+  const char* data = buffer.data();
+
+  for (; pos + last_offset + 32 <= buffer.size(); pos += 32) {
+    auto block_first =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+    auto block_last = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(data + pos + last_offset));
+
+    auto mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                              _mm256_cmpeq_epi8(block_last, last))));
+
+    while (mask != 0) {
+      size_t candidate = pos + __builtin_ctz(mask);
+      if (markerAt(buffer, candidate, marker)) {
+        return candidate;
+      }
+
+      mask &= mask - 1;
+    }
+  }
+
+  return findMarkerSSE2(buffer, pos, marker);
+}
+
+#elif defined(__aarch64__)
+size_t findMarkerNEON(std::string_view buffer,
+                      size_t pos,
+                      std::string_view marker) {
+  const size_t last_offset = marker.size() - 1;
+  const auto first = vdupq_n_u8(static_cast<std::uint8_t>(marker.front()));
+  const auto last = vdupq_n_u8(static_cast<std::uint8_t>(marker.back()));
+  const auto* data = reinterpret_cast<const std::uint8_t*>(buffer.data());
+
+  for (; pos + last_offset + 16 <= buffer.size(); pos += 16) {
+    auto matches = vandq_u8(vceqq_u8(vld1q_u8(data + pos), first),
+                            vceqq_u8(vld1q_u8(data + pos + last_offset), last));
+
+    // NEON has no movemask; narrowing gives 4 bits per byte instead
+    auto mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+
+    while (mask != 0) {
+      size_t candidate = pos + (__builtin_ctzll(mask) >> 2);
+      if (markerAt(buffer, candidate, marker)) {
+        return candidate;
+      }
+
+      mask &= ~(0xFULL << (__builtin_ctzll(mask) & ~3ULL));
+    }
+  }
+
+  return findMarkerPortable(buffer, pos, marker);
+}
+#endif
+
+struct MarkerScanner final {
+  FindMarkerFunction find;
+  const char* name;
+};
+
+MarkerScanner selectMarkerScanner() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return {findMarkerAVX2, "avx2"};
+  }
+
+  return {findMarkerSSE2, "sse2"};
+#elif defined(__aarch64__)
+  return {findMarkerNEON, "neon"};
+#else
+  return {findMarkerPortable, "portable"};
+#endif
+}
+
+const MarkerScanner& getMarkerScanner() {
+  static const MarkerScanner scanner = [] {
+    auto selected = selectMarkerScanner();
+    VLOG(1) << "Using the " << selected.name << " Santa log scanner";
+    return selected;
+  }();
+
+  return scanner;
+}
+
+// Santa's string log names every event kind other than executions by its
+// action
+struct ActionEventType final {
+  std::string_view action;
+  SantaEventType type;
+};
+
+// clang-format off
+constexpr std::array<ActionEventType, 9> kActionEventTypes = {{
+  {"FORK",          kFork},
+  {"EXIT",          kExit},
+  {"WRITE",         kWrite},
+  {"RENAME",        kRename},
+  {"LINK",          kLink},
+  {"DELETE",        kDelete},
+  {"DISKAPPEAR",    kDiskAppear},
+  {"DISKDISAPPEAR", kDiskDisappear},
+  {"ALLOWLIST",     kAllowlist},
+}};
+// clang-format on
+} // namespace
+
+size_t findLogMarker(std::string_view buffer,
+                     size_t pos,
+                     std::string_view marker) {
+  if (pos >= buffer.size() || marker.size() < 2) {
+    return buffer.find(marker, pos);
+  }
+
+  return getMarkerScanner().find(buffer, pos, marker);
+}
+
+bool getLineEventType(std::string_view line, SantaEventType& type) {
+  if (line.find("decision=ALLOW") != std::string_view::npos) {
+    type = kAllowed;
+    return true;
+  }
+
+  if (line.find("decision=DENY") != std::string_view::npos) {
+    type = kDenied;
+    return true;
+  }
+
+  auto action_start = line.find(kActionMarker);
+  if (action_start == std::string_view::npos) {
+    return false;
+  }
+
+  action_start += kActionMarker.size();
+  auto action = line.substr(action_start,
+                            line.find('|', action_start) - action_start);
+
+  for (const auto& action_type : kActionEventTypes) {
+    if (action_type.action == action) {
+      type = action_type.type;
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "santa.h"
+
+// Every execution line carries a decision, and every event line an action
+constexpr std::string_view kDecisionMarker = "decision=";
+constexpr std::string_view kActionMarker = "action=";
+
+// Returns the offset of the first occurrence of marker at or after pos, or
+// std::string_view::npos. Uses the widest vector unit available on the host.
+size_t findLogMarker(std::string_view buffer,
+                     size_t pos,
+                     std::string_view marker);
+
+// Tells which kind of event a log line records, if any
+bool getLineEventType(std::string_view line, SantaEventType& type);
+
+// Calls callback(line, type) for every line in a buffer of newline separated
+// lines whose event type is in types. When only executions are wanted, lines
+// without a decision marker are skipped by the vectorized search and never
+// looked at individually.
+template <typename Callback>
+void scanEventLines(std::string_view buffer,
+                    const SantaEventTypeSet& types,
+                    Callback&& callback) {
+  auto execution_types = SantaEventTypeSet().set(kAllowed).set(kDenied);
+  auto marker = (types & ~execution_types).none() ? kDecisionMarker
+                                                  : kActionMarker;
+
+  size_t line_start = 0;
+  size_t marker_pos;
+  while ((marker_pos = findLogMarker(buffer, line_start, marker)) !=
+         std::string_view::npos) {
+    size_t start = marker_pos;
+    while (start > line_start && buffer[start - 1] != '\n') {
+      --start;
+    }
+
+    size_t end = buffer.find('\n', marker_pos);
+    auto line = buffer.substr(start, end - start);
+
+    SantaEventType type;
+    if (getLineEventType(line, type) && types.test(type)) {
+      callback(line, type);
+    }
+
+    if (end == std::string_view::npos) {
+      break;
+    }
+
+    line_start = end + 1;
+  }
+}
@@ -0,0 +1,209 @@
+#include "logsource.h"
+
+#include <sys/stat.h>
+
+#include <sstream>
+
+#include <osquery/core/flags.h>
+#include <osquery/logger/logger.h>
+
+DECLARE_string(santa_log_path);
+
+FLAG(string,
+     santa_log_format,
+     "text",
+     "Format of the Santa event log: text (santa.log), json (JSON lines in "
+     "santa.log) or protobuf (spool files under --santa_spool_path)");
+
+size_t LogSource::getCompleteSize(std::string_view data) const {
+  size_t complete_size = 0;
+  size_t record_size;
+  while ((record_size = getRecordSize(data.substr(complete_size))) != 0) {
+    complete_size += record_size;
+  }
+
+  return complete_size;
+}
+
+std::vector<std::string_view> LogSource::splitRecords(std::string_view data,
+                                                      size_t chunk_size) const {
+  std::vector<std::string_view> chunks;
+  while (!data.empty()) {
+    auto chunk_end = data.size();
+    if (chunk_end > chunk_size) {
+      // a record longer than a chunk gets a chunk of its own
+      chunk_end = getCompleteSize(data.substr(0, chunk_size));
+      if (chunk_end == 0) {
+        chunk_end = getRecordSize(data);
+      }
+
+      if (chunk_end == 0) {
+        chunk_end = data.size();
+      }
+    }
+
+    chunks.push_back(data.substr(0, chunk_end));
+    data.remove_prefix(chunk_end);
+  }
+
+  return chunks;
+}
+
+bool LineLogSource::hasLiveLog() const {
+  return true;
+}
+
+std::string LineLogSource::getWatchedPath() const {
+  return FLAGS_santa_log_path;
+}
+
+std::vector<std::string> LineLogSource::listArchives() const {
+  std::vector<std::string> archives;
+  for (unsigned int i = 0;; ++i) {
+    std::stringstream strstr;
+    strstr << FLAGS_santa_log_path << "." << i << ".gz";
+
+    struct stat file_stat;
+    if (stat(strstr.str().c_str(), &file_stat) != 0) {
+      break;
+    }
+
+    archives.push_back(strstr.str());
+  }
+
+  return archives;
+}
+
+bool LineLogSource::archivesCompressed() const {
+  return true;
+}
+
+size_t LineLogSource::getRecordSize(std::string_view data) const {
+  auto newline = data.find('\n');
+  return (newline == std::string_view::npos) ? 0 : newline + 1;
+}
+
+size_t LineLogSource::getCompleteSize(std::string_view data) const {
+  auto newline = data.rfind('\n');
+  return (newline == std::string_view::npos) ? 0 : newline + 1;
+}
+
+const LogSource& getLogSource() {
+  static const auto text_source = createTextLogSource();
+  static const auto json_source = createJsonLogSource();
+  static const auto protobuf_source = createProtobufLogSource();
+
+  if (FLAGS_santa_log_format == "json") {
+    return *json_source;
+  }
+
+  if (FLAGS_santa_log_format == "protobuf") {
+    return *protobuf_source;
+  }
+
+  if (FLAGS_santa_log_format != "text") {
+    static bool warned = false;
+    if (!warned) {
+      VLOG(1) << "Unknown Santa log format " << FLAGS_santa_log_format
+              << ", reading the text log";
+      warned = true;
+    }
+  }
+
+  return *text_source;
+}
+
+namespace {
+
+bool parseDigits(std::string_view text,
+                 size_t offset,
+                 size_t count,
+                 std::int64_t& value) {
+  value = 0;
+  for (size_t i = offset; i < offset + count; ++i) {
+    if (text[i] < '0' || text[i] > '9') {
+      return false;
+    }
+
+    value = value * 10 + (text[i] - '0');
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool parseLogTimestamp(std::string_view timestamp, std::int64_t& time) {
+  // YYYY-MM-DDTHH:MM:SS, optionally followed by fractional seconds and Z
+  std::int64_t year, month, day, hour, minute, second;
+  if (timestamp.size() < 19 || timestamp[4] != '-' || timestamp[7] != '-' ||
+      timestamp[10] != 'T' || timestamp[13] != ':' || timestamp[16] != ':' ||
+      !parseDigits(timestamp, 0, 4, year) ||
+      !parseDigits(timestamp, 5, 2, month) ||
+      !parseDigits(timestamp, 8, 2, day) ||
+      !parseDigits(timestamp, 11, 2, hour) ||
+      !parseDigits(timestamp, 14, 2, minute) ||
+      !parseDigits(timestamp, 17, 2, second) || month < 1 || month > 12 ||
+      day < 1 || day > 31) {
+    return false;
+  }
+
+  // Days since 1970-01-01 in the proleptic Gregorian calendar, counting years
+  // from March so that the leap day comes last
+  year -= (month <= 2) ? 1 : 0;
+  std::int64_t era = year / 400;
+  std::int64_t year_of_era = year - era * 400;
+  std::int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  std::int64_t day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  std::int64_t days = era * 146097 + day_of_era - 719468;
+
+  time = days * 86400 + hour * 3600 + minute * 60 + second;
+  return true;
+}
+
+bool formatLogTimestamp(std::int64_t time,
+                        std::uint16_t millis,
+                        std::string& text) {
+  std::int64_t days = time / 86400;
+  std::int64_t seconds = time % 86400;
+  if (seconds < 0) {
+    seconds += 86400;
+    --days;
+  }
+
+  // Civil date from days since 1970-01-01, with years starting in March
+  std::int64_t shifted = days + 719468;
+  std::int64_t era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+  std::int64_t day_of_era = shifted - era * 146097;
+  std::int64_t year_of_era = (day_of_era - day_of_era / 1460 +
+                              day_of_era / 36524 - day_of_era / 146096) /
+                             365;
+  std::int64_t day_of_year =
+      day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  std::int64_t month_index = (5 * day_of_year + 2) / 153;
+  std::int64_t day = day_of_year - (153 * month_index + 2) / 5 + 1;
+  std::int64_t month = month_index < 10 ? month_index + 3 : month_index - 9;
+  std::int64_t year = year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+
+  if (year < 0 || year > 9999 || millis > 999) {
+    return false;
+  }
+
+  auto put = [&text](size_t offset, std::int64_t value, size_t width) {
+    for (size_t i = width; i > 0; --i) {
+      text[offset + i - 1] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    }
+  };
+
+  text = "0000-00-00T00:00:00.000Z";
+  put(0, year, 4);
+  put(5, month, 2);
+  put(8, day, 2);
+  put(11, seconds / 3600, 2);
+  put(14, seconds / 60 % 60, 2);
+  put(17, seconds % 60, 2);
+  put(20, millis, 3);
+  return true;
+}
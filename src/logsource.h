@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pathmatcher.h"
+#include "santa.h"
+
+// Called for every event decoded from the log. The entry's views are only
+// valid during the call.
+using LogEventCallback =
+    std::function<void(SantaEventType type, const LogEntryView& entry)>;
+
+// A format Santa writes its event log in: which files make up the log, how
+// records are framed in them and how they are decoded into decision fields.
+// Framing lets buffers be cut at record boundaries, which is what the
+// parallel parsing of the live log and the streaming of archives rely on.
+class LogSource {
+ public:
+  virtual ~LogSource() = default;
+
+  // Whether Santa appends to a live log at --santa_log_path. Its records are
+  // newline terminated, so that it can also be read backwards from its end.
+  virtual bool hasLiveLog() const = 0;
+
+  // A path in the directory where new records show up, to be watched
+  virtual std::string getWatchedPath() const = 0;
+
+  // The files Santa is done writing, newest first
+  virtual std::vector<std::string> listArchives() const = 0;
+
+  virtual bool archivesCompressed() const = 0;
+
+  // Size of the first record of data, 0 if it is not complete yet. Data that
+  // cannot be framed at all is taken as a single record, which then fails to
+  // decode, rather than waited on forever.
+  virtual size_t getRecordSize(std::string_view data) const = 0;
+
+  // Size of the complete records at the start of data
+  virtual size_t getCompleteSize(std::string_view data) const;
+
+  // Cuts the complete records of data into chunks of about chunk_size bytes
+  std::vector<std::string_view> splitRecords(std::string_view data,
+                                             size_t chunk_size) const;
+
+  // Calls callback for the events of the given types held by complete
+  // records. When path_matcher is given, events whose path does not match
+  // it may be left out, before they are fully decoded.
+  virtual void decode(std::string_view data,
+                      const SantaEventTypeSet& types,
+                      const PathMatcher* path_matcher,
+                      const LogEventCallback& callback) const = 0;
+
+  // Time of the first record of data, 0 if it has none. Records are written
+  // in time order, so no record after it is older.
+  virtual std::int64_t getFirstRecordTime(std::string_view data) const = 0;
+};
+
+// A log of newline terminated records: santa.log, rotated by newsyslog into
+// gzip archives next to it
+class LineLogSource : public LogSource {
+ public:
+  bool hasLiveLog() const override;
+  std::string getWatchedPath() const override;
+  std::vector<std::string> listArchives() const override;
+  bool archivesCompressed() const override;
+  size_t getRecordSize(std::string_view data) const override;
+  size_t getCompleteSize(std::string_view data) const override;
+};
+
+// The source selected by --santa_log_format
+const LogSource& getLogSource();
+
+std::unique_ptr<LogSource> createTextLogSource();
+std::unique_ptr<LogSource> createJsonLogSource();
+std::unique_ptr<LogSource> createProtobufLogSource();
+
+// Parses a Santa log timestamp (2023-04-05T06:07:08.123Z) into seconds since
+// the epoch
+bool parseLogTimestamp(std::string_view timestamp, std::int64_t& time);
+
+// Formats a time as YYYY-MM-DDTHH:MM:SS.mmmZ, the inverse of
+// parseLogTimestamp for the timestamps Santa writes
+bool formatLogTimestamp(std::int64_t time,
+                        std::uint16_t millis,
+                        std::string& text);
+
+// Splits a Santa text log line into its timestamp and fields
+LogEntryView parseLogLine(std::string_view line);
@@ -0,0 +1,207 @@
+#include "logwatcher.h"
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#elif defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <osquery/logger/logger.h>
+
+namespace {
+
+// Rotation replaces the file, so the directory holding it is watched too
+std::string getParentDirectory(const std::string& path) {
+  auto separator = path.find_last_of('/');
+  if (separator == std::string::npos) {
+    return ".";
+  }
+
+  return (separator == 0) ? "/" : path.substr(0, separator);
+}
+
+class PollingLogWatcher final : public LogWatcher {
+ public:
+  void wait(std::chrono::milliseconds timeout) override {
+    std::this_thread::sleep_for(timeout);
+  }
+};
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+
+#ifdef O_EVTONLY
+const int kWatchOpenFlags = O_EVTONLY;
+#else
+const int kWatchOpenFlags = O_RDONLY;
+#endif
+
+// Watches the file for writes and the directory for a new file replacing it.
+// A file that was renamed or deleted stops being watched, and whatever then
+// sits at its path is watched from the next wait on.
+class KqueueLogWatcher final : public LogWatcher {
+ public:
+  KqueueLogWatcher(const std::string& path, int queue, int directory_fd)
+      : path_(path), queue_(queue), directory_fd_(directory_fd) {}
+
+  ~KqueueLogWatcher() override {
+    if (file_fd_ != -1) {
+      close(file_fd_);
+    }
+
+    close(directory_fd_);
+    close(queue_);
+  }
+
+  static std::unique_ptr<LogWatcher> create(const std::string& path) {
+    int queue = kqueue();
+    if (queue == -1) {
+      VLOG(1) << "Failed to create a kqueue: " << std::strerror(errno);
+      return nullptr;
+    }
+
+    auto directory = getParentDirectory(path);
+    int directory_fd = open(directory.c_str(), kWatchOpenFlags);
+    if (directory_fd == -1 || !addWatch(queue, directory_fd)) {
+      VLOG(1) << "Failed to watch " << directory << ": "
+              << std::strerror(errno);
+      if (directory_fd != -1) {
+        close(directory_fd);
+      }
+
+      close(queue);
+      return nullptr;
+    }
+
+    return std::make_unique<KqueueLogWatcher>(path, queue, directory_fd);
+  }
+
+  void wait(std::chrono::milliseconds timeout) override {
+    if (file_fd_ == -1) {
+      watchFile();
+    }
+
+    struct timespec interval;
+    interval.tv_sec = timeout.count() / 1000;
+    interval.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+    struct kevent event;
+    int count = kevent(queue_, nullptr, 0, &event, 1, &interval);
+    if (count > 0 && file_fd_ != -1 &&
+        event.ident == static_cast<uintptr_t>(file_fd_) &&
+        (event.fflags & (NOTE_DELETE | NOTE_RENAME)) != 0) {
+      // closing the descriptor also removes its event
+      close(file_fd_);
+      file_fd_ = -1;
+    }
+  }
+
+ private:
+  static bool addWatch(int queue, int fd) {
+    struct kevent change;
+    EV_SET(&change,
+           fd,
+           EVFILT_VNODE,
+           EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME,
+           0,
+           nullptr);
+
+    return kevent(queue, &change, 1, nullptr, 0, nullptr) != -1;
+  }
+
+  void watchFile() {
+    file_fd_ = open(path_.c_str(), kWatchOpenFlags);
+    if (file_fd_ != -1 && !addWatch(queue_, file_fd_)) {
+      close(file_fd_);
+      file_fd_ = -1;
+    }
+  }
+
+  std::string path_;
+  int queue_;
+  int directory_fd_;
+  int file_fd_{-1};
+};
+
+#elif defined(__linux__)
+
+// Watches the directory, which reports writes to the files in it as well as
+// the file being replaced
+class InotifyLogWatcher final : public LogWatcher {
+ public:
+  explicit InotifyLogWatcher(int fd) : fd_(fd) {}
+
+  ~InotifyLogWatcher() override {
+    close(fd_);
+  }
+
+  static std::unique_ptr<LogWatcher> create(const std::string& path) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+      VLOG(1) << "Failed to initialize inotify: " << std::strerror(errno);
+      return nullptr;
+    }
+
+    auto directory = getParentDirectory(path);
+    if (inotify_add_watch(fd,
+                          directory.c_str(),
+                          IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                              IN_MOVED_TO) == -1) {
+      VLOG(1) << "Failed to watch " << directory << ": "
+              << std::strerror(errno);
+      close(fd);
+      return nullptr;
+    }
+
+    return std::make_unique<InotifyLogWatcher>(fd);
+  }
+
+  void wait(std::chrono::milliseconds timeout) override {
+    struct pollfd descriptor = {fd_, POLLIN, 0};
+    if (poll(&descriptor, 1, static_cast<int>(timeout.count())) <= 0) {
+      return;
+    }
+
+    // The events themselves do not matter, only that there were some
+    char buffer[4096];
+    while (read(fd_, buffer, sizeof(buffer)) > 0) {
+    }
+  }
+
+ private:
+  int fd_;
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<LogWatcher> createLogWatcher(const std::string& path,
+                                             bool polling) {
+  std::unique_ptr<LogWatcher> watcher;
+  if (!polling) {
+#if defined(__APPLE__) || defined(__FreeBSD__)
+    watcher = KqueueLogWatcher::create(path);
+#elif defined(__linux__)
+    watcher = InotifyLogWatcher::create(path);
+#endif
+
+    if (watcher == nullptr) {
+      VLOG(1) << "Polling " << path << " for changes";
+    }
+  }
+
+  if (watcher == nullptr) {
+    watcher = std::make_unique<PollingLogWatcher>();
+  }
+
+  return watcher;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+// Waits for a log file to change. A watcher may wake up for changes nobody
+// cares about, or miss some altogether; callers look at the file again after
+// every wait and only count on the timeout to make progress.
+class LogWatcher {
+ public:
+  virtual ~LogWatcher() = default;
+
+  // Returns once the file may have changed, or when the timeout expires
+  virtual void wait(std::chrono::milliseconds timeout) = 0;
+};
+
+// Watches path through the platform's file notifications (kqueue on macOS,
+// inotify on Linux). Falls back to polling when there are none, when they
+// cannot be set up, or when polling is requested.
+std::unique_ptr<LogWatcher> createLogWatcher(const std::string& path,
+                                             bool polling);
@@ -1,10 +1,18 @@
 // Description: The main entry point for the Santa extension
 #include <osquery/core/system.h>
+#include <osquery/events/events.h>
 #include <osquery/sdk/sdk.h>
 
+#include "santa.h"
+
 // Include the Santa table implementations
 #include "santarulestable.h"
 #include "santadecisionstable.h"
+#include "santacachetable.h"
+#include "santadecisioneventstable.h"
+#include "santalogpublisher.h"
+#include "santasummarytable.h"
+#include "santatopktable.h"
 
 using namespace osquery;
 
@@ -12,11 +20,29 @@ using namespace osquery;
 REGISTER_EXTERNAL(SantaRulesTablePlugin, "table", "santa_rules");
 REGISTER_EXTERNAL(SantaAllowedDecisionsTablePlugin, "table", "santa_allowed");
 REGISTER_EXTERNAL(SantaDeniedDecisionsTablePlugin, "table", "santa_denied");
+REGISTER_EXTERNAL(SantaCacheUsageTablePlugin, "table", "santa_cache_usage");
+REGISTER_EXTERNAL(SantaDecisionSummaryTablePlugin,
+                  "table",
+                  "santa_decision_summary");
+REGISTER_EXTERNAL(SantaDeniedTopKTablePlugin, "table", "santa_denied_topk");
+
+// The evented table is fed by a publisher following the Santa log
+REGISTER_EXTERNAL(SantaLogEventPublisher, "event_publisher", "santa_log");
+REGISTER_EXTERNAL(SantaDecisionEventSubscriber,
+                  "event_subscriber",
+                  "santa_decision_events");
+REGISTER_EXTERNAL(SantaDecisionEventsTablePlugin,
+                  "table",
+                  "santa_decision_events");
 
 int main(int argc, char* argv[]) {
   // This extension is meant to be registered with osqueryi or osqueryd.
   osquery::Initializer runner(argc, argv, ToolType::EXTENSION);
 
+  // Start the publisher and subscriber behind santa_decision_events
+  attachEvents();
+  EventFactory::delay();
+
   // Start the extension - this communicates with the osquery process
   auto status = startExtension("santa", "0.1.0");
   if (!status.ok()) {
@@ -26,5 +52,8 @@ int main(int argc, char* argv[]) {
 
   // Finally wait for a signal / interrupt to shutdown.
   runner.waitForShutdown();
+
+  // Before static objects a background log scan may use are destroyed
+  stopSantaLogScans();
   return runner.shutdown(0);
 }
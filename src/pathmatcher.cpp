@@ -0,0 +1,319 @@
+#include "pathmatcher.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace {
+
+unsigned char foldCase(unsigned char byte) {
+  return (byte >= 'A' && byte <= 'Z') ? static_cast<unsigned char>(byte + 32)
+                                      : byte;
+}
+
+std::uint32_t foldCase(std::uint32_t character) {
+  return (character < 128) ? foldCase(static_cast<unsigned char>(character))
+                           : character;
+}
+
+// Reads the UTF-8 character at pos and moves past it. Like SQLite, a lead
+// byte takes every continuation byte after it, and a stray byte stands for
+// itself.
+std::uint32_t readChar(std::string_view text, size_t& pos) {
+  auto lead = static_cast<unsigned char>(text[pos++]);
+  if (lead < 0xC0) {
+    return lead;
+  }
+
+  std::uint32_t character =
+      lead & ((lead >= 0xF0) ? 0x07 : (lead >= 0xE0) ? 0x0F : 0x1F);
+  while (pos < text.size() &&
+         (static_cast<unsigned char>(text[pos]) & 0xC0) == 0x80) {
+    character = (character << 6) | (static_cast<unsigned char>(text[pos]) & 0x3F);
+    ++pos;
+  }
+
+  return character;
+}
+
+} // namespace
+
+PathMatcher::PathMatcher(const std::vector<PathPattern>& patterns) {
+  nodes_.emplace_back();
+  for (const auto& pattern : patterns) {
+    compile(pattern);
+  }
+
+  buildAutomaton();
+}
+
+bool PathMatcher::mayMatch(std::string_view text) const {
+  if (fragments_.empty()) {
+    return true;
+  }
+
+  // Patterns rarely have more than a handful of fragments
+  std::uint64_t found_mask = 0;
+  std::vector<bool> found(fragments_.size() > 64 ? fragments_.size() : 0);
+  size_t found_count = 0;
+
+  std::uint32_t state = 0;
+  for (auto byte : text) {
+    state = nodes_[state].next[foldCase(static_cast<unsigned char>(byte))];
+
+    auto output = (nodes_[state].fragment != kNoFragment)
+                      ? state
+                      : nodes_[state].output_link;
+    for (; output != 0; output = nodes_[output].output_link) {
+      auto fragment = nodes_[output].fragment;
+      if (found.empty()) {
+        if ((found_mask & (1ULL << fragment)) != 0) {
+          continue;
+        }
+
+        found_mask |= 1ULL << fragment;
+
+      } else {
+        if (found[fragment]) {
+          continue;
+        }
+
+        found[fragment] = true;
+      }
+
+      if (++found_count == fragments_.size()) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+bool PathMatcher::matches(std::string_view value) const {
+  if (!mayMatch(value)) {
+    return false;
+  }
+
+  for (const auto& pattern : patterns_) {
+    if (!matchesPattern(pattern, value)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void PathMatcher::compile(const PathPattern& pattern) {
+  CompiledPattern compiled;
+  compiled.ignore_case = (pattern.syntax == PathPattern::Syntax::Like);
+
+  const auto& text = pattern.text;
+  std::string fragment;
+  auto end_fragment = [this, &fragment]() {
+    if (!fragment.empty()) {
+      addFragment(fragment);
+      fragment.clear();
+    }
+  };
+
+  size_t pos = 0;
+  while (pos < text.size()) {
+    auto start = pos;
+    auto character = readChar(text, pos);
+
+    Token token;
+    if (compiled.ignore_case && character == '%') {
+      token.kind = Token::Kind::AnySequence;
+    } else if (compiled.ignore_case && character == '_') {
+      token.kind = Token::Kind::AnyChar;
+    } else if (!compiled.ignore_case && character == '*') {
+      token.kind = Token::Kind::AnySequence;
+    } else if (!compiled.ignore_case && character == '?') {
+      token.kind = Token::Kind::AnyChar;
+
+    } else if (!compiled.ignore_case && character == '[') {
+      // [^...] negates, and a ] right after the opening one is a member
+      CharClass char_class;
+      if (pos < text.size() && text[pos] == '^') {
+        char_class.negated = true;
+        ++pos;
+      }
+
+      bool first = true;
+      bool terminated = false;
+      while (pos < text.size()) {
+        auto member = readChar(text, pos);
+        if (member == ']' && !first) {
+          terminated = true;
+          break;
+        }
+
+        first = false;
+        if (pos + 1 < text.size() && text[pos] == '-' && text[pos + 1] != ']') {
+          ++pos;
+          auto last = readChar(text, pos);
+          char_class.ranges.emplace_back(member, last);
+        } else {
+          char_class.ranges.emplace_back(member, member);
+        }
+      }
+
+      if (!terminated) {
+        compiled.valid = false;
+        break;
+      }
+
+      token.kind = Token::Kind::Class;
+      token.char_class = char_classes_.size();
+      char_classes_.push_back(std::move(char_class));
+
+    } else {
+      token.kind = Token::Kind::Literal;
+      token.character = compiled.ignore_case ? foldCase(character) : character;
+      fragment.append(text, start, pos - start);
+      compiled.tokens.push_back(token);
+      continue;
+    }
+
+    end_fragment();
+    compiled.tokens.push_back(token);
+  }
+
+  end_fragment();
+  patterns_.push_back(std::move(compiled));
+}
+
+void PathMatcher::addFragment(const std::string& fragment) {
+  std::string folded;
+  for (auto byte : fragment) {
+    folded.push_back(
+        static_cast<char>(foldCase(static_cast<unsigned char>(byte))));
+  }
+
+  std::uint32_t node = 0;
+  for (auto byte : folded) {
+    auto& next = nodes_[node].next[static_cast<unsigned char>(byte)];
+    if (next == 0) {
+      next = static_cast<std::uint32_t>(nodes_.size());
+      nodes_.emplace_back();
+    }
+
+    node = nodes_[node].next[static_cast<unsigned char>(byte)];
+  }
+
+  if (nodes_[node].fragment == kNoFragment) {
+    nodes_[node].fragment = fragments_.size();
+    fragments_.push_back(std::move(folded));
+  }
+}
+
+void PathMatcher::buildAutomaton() {
+  // Breadth first, so that every fail target is complete before it is used.
+  // Missing transitions are filled in from the fail target, which turns the
+  // trie into a DFA.
+  std::deque<std::uint32_t> queue;
+  for (auto child : nodes_[0].next) {
+    if (child != 0) {
+      queue.push_back(child);
+    }
+  }
+
+  while (!queue.empty()) {
+    auto node = queue.front();
+    queue.pop_front();
+
+    const auto& fail = nodes_[nodes_[node].fail];
+    nodes_[node].output_link =
+        (fail.fragment != kNoFragment) ? nodes_[node].fail : fail.output_link;
+
+    for (size_t byte = 0; byte < 256; ++byte) {
+      auto child = nodes_[node].next[byte];
+      auto fail_next = nodes_[nodes_[node].fail].next[byte];
+      if (child == 0) {
+        nodes_[node].next[byte] = fail_next;
+        continue;
+      }
+
+      nodes_[child].fail = fail_next;
+      queue.push_back(child);
+    }
+  }
+}
+
+bool PathMatcher::matchesPattern(const CompiledPattern& pattern,
+                                 std::string_view value) const {
+  if (!pattern.valid) {
+    return false;
+  }
+
+  // Single character tokens between wildcards only ever need to retry from
+  // the last wildcard, one character further on
+  const auto& tokens = pattern.tokens;
+  size_t token = 0;
+  size_t pos = 0;
+  size_t retry_token = tokens.size() + 1;
+  size_t retry_pos = 0;
+
+  while (pos < value.size()) {
+    if (token < tokens.size() &&
+        tokens[token].kind == Token::Kind::AnySequence) {
+      retry_token = ++token;
+      retry_pos = pos;
+      continue;
+    }
+
+    auto next_pos = pos;
+    auto character = readChar(value, next_pos);
+    if (token < tokens.size() &&
+        matchesToken(pattern, tokens[token], character)) {
+      ++token;
+      pos = next_pos;
+      continue;
+    }
+
+    if (retry_token > tokens.size()) {
+      return false;
+    }
+
+    readChar(value, retry_pos);
+    token = retry_token;
+    pos = retry_pos;
+  }
+
+  while (token < tokens.size() &&
+         tokens[token].kind == Token::Kind::AnySequence) {
+    ++token;
+  }
+
+  return token == tokens.size();
+}
+
+bool PathMatcher::matchesToken(const CompiledPattern& pattern,
+                               const Token& token,
+                               std::uint32_t character) const {
+  switch (token.kind) {
+  case Token::Kind::Literal:
+    return token.character ==
+           (pattern.ignore_case ? foldCase(character) : character);
+
+  case Token::Kind::AnyChar:
+    return true;
+
+  case Token::Kind::Class: {
+    const auto& char_class = char_classes_[token.char_class];
+    auto member = std::any_of(
+        char_class.ranges.begin(),
+        char_class.ranges.end(),
+        [character](const std::pair<std::uint32_t, std::uint32_t>& range) {
+          return character >= range.first && character <= range.second;
+        });
+
+    return member != char_class.negated;
+  }
+
+  case Token::Kind::AnySequence:
+    break;
+  }
+
+  return false;
+}
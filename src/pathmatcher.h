@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A LIKE or GLOB pattern, as SQLite reads them: LIKE has % and _ and ignores
+// ASCII case, GLOB has *, ? and [...] classes and does not
+struct PathPattern final {
+  enum class Syntax { Like, Glob };
+
+  Syntax syntax{Syntax::Like};
+  std::string text;
+};
+
+// Matches a value against every one of a set of patterns. The literal
+// fragments of all the patterns go into a single Aho-Corasick automaton that
+// ignores case, so one pass over a value, or over a whole log line holding it,
+// tells whether each pattern can match at all; only then is the value checked
+// against the patterns themselves.
+class PathMatcher final {
+ public:
+  explicit PathMatcher(const std::vector<PathPattern>& patterns);
+
+  // Tells whether text holds every literal fragment of every pattern, ignoring
+  // case. False means no value found in text can match.
+  bool mayMatch(std::string_view text) const;
+
+  // Tells whether value matches every pattern
+  bool matches(std::string_view value) const;
+
+ private:
+  static constexpr size_t kNoFragment = static_cast<size_t>(-1);
+
+  // A pattern element matching a single character
+  struct CharClass final {
+    bool negated{false};
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+  };
+
+  struct Token final {
+    enum class Kind { Literal, AnyChar, AnySequence, Class };
+
+    Kind kind{Kind::Literal};
+    std::uint32_t character{0}; // of a literal
+    size_t char_class{0}; // index in char_classes_
+  };
+
+  struct CompiledPattern final {
+    bool ignore_case{false};
+    bool valid{true}; // an unterminated [ matches nothing
+    std::vector<Token> tokens;
+  };
+
+  struct Node final {
+    std::array<std::uint32_t, 256> next{};
+    std::uint32_t fail{0};
+
+    // The fragment ending here, if any, and the nearest node on the fail
+    // chain that ends one
+    size_t fragment{kNoFragment};
+    std::uint32_t output_link{0};
+  };
+
+  void compile(const PathPattern& pattern);
+  void addFragment(const std::string& fragment);
+  void buildAutomaton();
+
+  bool matchesPattern(const CompiledPattern& pattern,
+                      std::string_view value) const;
+  bool matchesToken(const CompiledPattern& pattern,
+                    const Token& token,
+                    std::uint32_t character) const;
+
+  std::vector<CompiledPattern> patterns_;
+  std::vector<CharClass> char_classes_;
+  std::vector<std::string> fragments_;
+  std::vector<Node> nodes_;
+};
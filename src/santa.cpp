@@ -1,12 +1,41 @@
 #include "santa.h"
-
-#include <fstream>
-#include <iostream>
+#include "archiveindex.h"
+#include "boundedqueue.h"
+#include "databasesnapshot.h"
+#include "decisionstore.h"
+#include "heavyhitters.h"
+#include "logsource.h"
+#include "scanbudget.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <functional>
+#include <future>
+#include <limits>
 #include <map>
-#include <sstream>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include <zlib.h>
 
+#include <osquery/core/flags.h>
 #include <osquery/logger/logger.h>
 
 // Boost iostreams removed to eliminate dependency
@@ -15,183 +44,1587 @@
 
 #include <sqlite3.h>
 
-const std::string kSantaLogPath = "/var/db/santa/santa.log";
-const std::string kLogEntryPreface = "santad: ";
+FLAG(string,
+     santa_log_path,
+     "/var/db/santa/santa.log",
+     "Path of the live Santa log, its archives are read from the same "
+     "directory");
+
+FLAG(uint64,
+     santa_gzip_buffer_size,
+     65536,
+     "Size in bytes of the buffers used to stream Santa log archives");
+
+FLAG(int32,
+     santa_gzip_window_bits,
+     15,
+     "Inflate window size (base two logarithm, 9-15) for Santa log archives, "
+     "must not be smaller than the window they were compressed with");
+
+FLAG(uint64,
+     santa_archive_threads,
+     2,
+     "Maximum number of threads used to inflate new Santa log archives");
+
+FLAG(uint64,
+     santa_archive_pipeline_min_size,
+     8388608,
+     "Compressed size in bytes from which a Santa log archive is inflated and "
+     "parsed on separate threads (0 disables the pipeline)");
+
+FLAG(uint64,
+     santa_archive_pipeline_threads,
+     1,
+     "Number of parser threads in the Santa log archive pipeline");
+
+FLAG(uint64,
+     santa_log_parse_threads,
+     2,
+     "Maximum number of threads used to parse new data in the live Santa log");
+
+FLAG(uint64,
+     santa_log_chunk_size,
+     4194304,
+     "Size in bytes of the chunks the live Santa log is split into for "
+     "parallel parsing");
+
+FLAG(uint64,
+     santa_log_reverse_block_size,
+     1048576,
+     "Size in bytes of the blocks the live Santa log is read in, from its "
+     "end, by queries that only want its newest decisions");
+
+FLAG(uint64,
+     santa_query_time_budget,
+     5000,
+     "Milliseconds a Santa decision query waits for the log to be scanned "
+     "before it returns the rows cached so far (0 waits for the scan)");
+
+FLAG(uint64,
+     santa_query_cpu_budget,
+     0,
+     "Milliseconds of process CPU time a Santa decision query lets the scan "
+     "use before it returns the rows cached so far (0 for no limit)");
+
+FLAG(uint64,
+     santa_scan_cpu_limit,
+     0,
+     "Share of one CPU in percent that scans of the Santa log are paced to "
+     "(0 lets them run at full speed)");
+
+FLAG(uint64,
+     santa_retention_max_age,
+     0,
+     "Age in seconds beyond which cached Santa decisions are dropped "
+     "(0 keeps them regardless of age)");
+
+FLAG(uint64,
+     santa_retention_max_rows,
+     0,
+     "Maximum number of Santa decisions kept in the cache (0 for no limit)");
+
+FLAG(uint64,
+     santa_retention_max_bytes,
+     268435456,
+     "Approximate maximum memory in bytes used by the Santa decision cache "
+     "(0 for no limit)");
+
+FLAG(uint64,
+     santa_topk_size,
+     20,
+     "Number of most denied binaries tracked per day for santa_denied_topk");
+
+FLAG(uint64,
+     santa_topk_days,
+     30,
+     "Number of days of denials kept for santa_denied_topk");
+
+FLAG(uint64,
+     santa_topk_sketch_width,
+     2048,
+     "Counters per row of the santa_denied_topk sketches, which overestimate "
+     "by at most e/width of the denials counted");
+
+FLAG(uint64,
+     santa_topk_sketch_depth,
+     4,
+     "Rows of the santa_denied_topk sketches, whose error bound holds with "
+     "probability 1 - e^-depth");
+
+FLAG(bool,
+     santa_archive_index,
+     true,
+     "Keep the parsed Santa log archives in an index file, so that they are "
+     "not inflated again when the extension restarts");
+
+FLAG(string,
+     santa_archive_index_path,
+     "/var/db/osquery_santa_archive.idx",
+     "Path of the Santa log archive index");
 
 const std::string kSantaDatabasePath = "/var/db/santa/rules.db";
-const std::string kTemporaryDatabasePath = "/tmp/rules.db";
 
-std::list<std::string> archived_lines;
-unsigned int next_oldest_archive = 0;
+const size_t kArchiveFingerprintBlockSize = 4096;
+
+// Everything parsed so far. A published snapshot is never modified: queries
+// read the one that was current when they started without taking any lock,
+// while a single writer builds and publishes the next one.
+struct LogSnapshot final {
+  // The live log, in segments in log order
+  std::vector<SharedPartitions> current_log_segments;
+
+  // The cached archives, newest first
+  std::vector<std::pair<ArchiveFingerprint, SharedPartitions>> archives;
+};
+
+// Only read and replaced through std::atomic_load and std::atomic_store
+std::shared_ptr<const LogSnapshot> current_snapshot =
+    std::make_shared<const LogSnapshot>();
+
+// Held by the writer while it refreshes the snapshot. It also guards the
+// writer's own state below, which queries never look at.
+std::mutex writer_mutex;
+
+// The event types that are kept when scanning. A table reading another type
+// adds it, and everything is scanned again once to fill its partition.
+SantaEventTypeSet partitioned_event_types =
+    SantaEventTypeSet().set(kAllowed).set(kDenied);
+
+// Where the last scan of the live log stopped. The offset always points just
+// past the last complete line; a trailing line that was not yet terminated is
+// read again in place from the mapping on the next scan.
+struct LogCheckpoint final {
+  ino_t inode{0};
+  off_t offset{0};
+};
+
+LogCheckpoint current_log_checkpoint;
+
+// Archives that fell outside the retention limits. They, and every archive
+// older than them, are not read again.
+std::set<ArchiveFingerprint> evicted_archives;
+
+// Paces every scan of the log to --santa_scan_cpu_limit
+ScanThrottle scan_throttle;
+
+// Set when the extension shuts down. No refresh starts after that, and the
+// one running gives up on the archives it has not finished inflating.
+std::atomic<bool> scans_stopped(false);
+
+// What the denied heavy hitters have counted. Each archive is counted once.
+// The live log is counted in time order from its first entry counted on,
+// which covers it after it is archived too: new archives only add what is
+// older than that, or what comes after the last entry counted.
+struct DenialCount final {
+  std::set<ArchiveFingerprint> archives;
+  std::int64_t live_log_start{std::numeric_limits<std::int64_t>::max()};
+
+  // Time of the last entry counted, and how many were counted with that time.
+  // The ones a log file holds with that time come first in it.
+  std::int64_t last_time{std::numeric_limits<std::int64_t>::min()};
+  size_t last_time_count{0};
+};
+
+DenialCount denial_count;
+
+// Denied binaries by day since the epoch, over the last --santa_topk_days.
+// Unlike the cache they are never trimmed by retention, only by age.
+std::mutex heavy_hitters_mutex;
+std::map<std::int64_t, HeavyHitters> denied_heavy_hitters;
+
+void ingestRecords(std::string_view records, EventPartitions& entries) {
+  getLogSource().decode(
+      records,
+      partitioned_event_types,
+      nullptr,
+      [&entries](SantaEventType type, const LogEntryView& entry) {
+        entries[type].add(entry);
+      });
+}
+
+// Hands every complete record in the buffer to the store. Bytes after the
+// last complete record are carried over in partial_record until a later
+// buffer completes them; records that fit in the buffer are never copied.
+void ingestBuffer(const char* buffer,
+                  size_t size,
+                  std::string& partial_record,
+                  EventPartitions& entries) {
+  const auto& source = getLogSource();
+  std::string_view data(buffer, size);
+
+  if (!partial_record.empty()) {
+    // The carried record grows geometrically until it is complete, so that
+    // finding its end stays linear in its size
+    auto carried = partial_record.size();
+    size_t appended = 0;
+    size_t record_size = 0;
+    while (record_size == 0 && appended < data.size()) {
+      auto count = std::min(data.size() - appended,
+                            std::max<size_t>(partial_record.size(), 256U));
+      partial_record.append(data.substr(appended, count));
+      appended += count;
+      record_size = source.getRecordSize(partial_record);
+    }
+
+    if (record_size == 0) {
+      return;
+    }
+
+    ingestRecords(std::string_view(partial_record).substr(0, record_size),
+                  entries);
+    data.remove_prefix(record_size - carried);
+    partial_record.clear();
+  }
+
+  auto complete_size = source.getCompleteSize(data);
+  ingestRecords(data.substr(0, complete_size), entries);
+  partial_record.assign(data.substr(complete_size));
+}
+
+// Parses a buffer of complete records. Large buffers (typically the whole
+// live log on the first scan) are cut into chunks at record boundaries, which
+// are parsed concurrently and appended in their original order.
+void ingestRecordsInParallel(std::string_view records,
+                             EventPartitions& entries) {
+  auto chunk_size = static_cast<size_t>(
+      std::max<std::uint64_t>(FLAGS_santa_log_chunk_size, 65536U));
+
+  auto chunks = getLogSource().splitRecords(records, chunk_size);
+
+  std::vector<EventPartitions> chunk_entries(chunks.size());
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    tasks.push_back([&chunks, &chunk_entries, i]() {
+      scan_throttle.pace(FLAGS_santa_scan_cpu_limit);
+      ingestRecords(chunks[i], chunk_entries[i]);
+    });
+  }
+
+  runInParallel(tasks, FLAGS_santa_log_parse_threads);
+
+  for (auto& current_entries : chunk_entries) {
+    for (auto& partition : current_entries) {
+      auto& destination = entries[partition.first];
+      destination.append(std::move(partition.second));
+    }
+  }
+}
+
+size_t getRowCount(const EventPartitions& partitions) {
+  size_t rows = 0;
+  for (const auto& partition : partitions) {
+    rows += partition.second.size();
+  }
+
+  return rows;
+}
 
-void extractValues(const std::string& line,
-                   std::map<std::string, std::string>& values) {
-  values.clear();
+size_t getMemoryUsage(const EventPartitions& partitions) {
+  size_t bytes = 0;
+  for (const auto& partition : partitions) {
+    bytes += partition.second.memoryUsage();
+  }
+
+  return bytes;
+}
 
-  // extract timestamp
-  size_t timestamp_start = line.find("[");
-  size_t timestamp_end = line.find("]");
+void resetCurrentLog(ino_t inode, LogSnapshot& snapshot) {
+  current_log_checkpoint = {};
+  current_log_checkpoint.inode = inode;
+  snapshot.current_log_segments.clear();
+}
 
-  if (timestamp_start != std::string::npos &&
-      timestamp_end != std::string::npos && timestamp_start != timestamp_end) {
-    values["timestamp"] =
-        line.substr(timestamp_start + 1, timestamp_end - timestamp_start - 1);
+// Drops what was parsed from the live log once it was rotated or truncated,
+// whether or not it is read again: its old contents come back as the newest
+// archive, and would otherwise be returned twice
+void dropRotatedCurrentLog(LogSnapshot& snapshot) {
+  struct stat file_stat;
+  if (stat(FLAGS_santa_log_path.c_str(), &file_stat) != 0) {
+    file_stat = {};
   }
 
-  // extract key=value pairs after the kLogEntryPreface
-  size_t key_pos = line.find(kLogEntryPreface);
-  if (key_pos == std::string::npos) {
+  if (file_stat.st_ino != current_log_checkpoint.inode ||
+      file_stat.st_size < current_log_checkpoint.offset) {
+    VLOG(1) << "The Santa log was rotated or truncated, dropping what was "
+               "parsed from it";
+    resetCurrentLog(file_stat.st_ino, snapshot);
+  }
+}
+
+// Adds what was parsed from the end of the live log to the snapshot. Segments
+// are merged as they pile up so that each one is more than twice as large as
+// the next: there are only logarithmically many of them, and each line is
+// copied a logarithmic number of times.
+void appendCurrentLogSegment(LogSnapshot& snapshot, EventPartitions segment) {
+  if (getRowCount(segment) == 0) {
     return;
   }
 
-  key_pos += kLogEntryPreface.length();
-  size_t key_end, val_pos, val_end;
-  while ((key_end = line.find('=', key_pos)) != std::string::npos) {
-    if ((val_pos = line.find_first_not_of("=", key_end)) == std::string::npos) {
+  auto merged = std::make_shared<EventPartitions>(std::move(segment));
+  auto& segments = snapshot.current_log_segments;
+  while (!segments.empty() &&
+         getRowCount(*segments.back()) <= 2 * getRowCount(*merged)) {
+    auto combined = std::make_shared<EventPartitions>();
+    for (const auto& partition : *segments.back()) {
+      (*combined)[partition.first].append(partition.second);
+    }
+
+    for (auto& partition : *merged) {
+      (*combined)[partition.first].append(std::move(partition.second));
+    }
+
+    segments.pop_back();
+    merged = std::move(combined);
+  }
+
+  segments.push_back(std::move(merged));
+}
+
+// Parses whatever was appended to the live log since the last call, walking
+// the new bytes in place through a read-only mapping. A new inode means the
+// log was rotated (its old contents now live in the first archive) and a file
+// smaller than our offset means it was truncated; both start the scan over
+// from the beginning.
+void tailCurrentLog(LogSnapshot& snapshot) {
+  int fd = open(FLAGS_santa_log_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    resetCurrentLog(0, snapshot);
+    return;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    resetCurrentLog(0, snapshot);
+    return;
+  }
+
+  if (file_stat.st_ino != current_log_checkpoint.inode ||
+      file_stat.st_size < current_log_checkpoint.offset) {
+    VLOG(1) << "The Santa log was rotated or truncated, rescanning it";
+    resetCurrentLog(file_stat.st_ino, snapshot);
+  }
+
+  if (file_stat.st_size == current_log_checkpoint.offset) {
+    close(fd);
+    return;
+  }
+
+  // mmap offsets have to be page aligned
+  static const off_t page_size = sysconf(_SC_PAGESIZE);
+  off_t map_offset = current_log_checkpoint.offset & ~(page_size - 1);
+  size_t map_size = static_cast<size_t>(file_stat.st_size - map_offset);
+
+  void* mapping = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    VLOG(1) << "Failed to map the Santa log: " << strerror(errno);
+    return;
+  }
+
+  const char* data = static_cast<const char*>(mapping) +
+                     (current_log_checkpoint.offset - map_offset);
+  size_t size = static_cast<size_t>(file_stat.st_size -
+                                    current_log_checkpoint.offset);
+
+  // stop after the last complete record, the rest is still being written
+  auto complete_size =
+      getLogSource().getCompleteSize(std::string_view(data, size));
+
+  if (complete_size > 0) {
+    EventPartitions segment;
+    ingestRecordsInParallel(std::string_view(data, complete_size), segment);
+    appendCurrentLogSegment(snapshot, std::move(segment));
+    current_log_checkpoint.offset += complete_size;
+  }
+
+  munmap(mapping, map_size);
+}
+
+// Collects the newest entries of the live log by reading it backwards from
+// its end, one block at a time, until the filter's time window or row count
+// is covered. Returns false when the live log alone does not cover them and
+// the cache has to be used instead. Nothing read here is cached.
+bool scrapeCurrentLogBackwards(LogEntries& response,
+                               SantaEventType type,
+                               const DecisionFilter& filter) {
+  response.clear();
+
+  const auto& source = getLogSource();
+  if (!source.hasLiveLog()) {
+    return false;
+  }
+
+  int fd = open(FLAGS_santa_log_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    close(fd);
+    return false;
+  }
+
+  // Only the pages of the blocks actually read are faulted in
+  auto file_size = static_cast<size_t>(file_stat.st_size);
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    VLOG(1) << "Failed to map the Santa log: " << strerror(errno);
+    return false;
+  }
+
+  const char* data = static_cast<const char*>(mapping);
+  auto block_size = static_cast<size_t>(
+      std::max<std::uint64_t>(FLAGS_santa_log_reverse_block_size, 65536U));
+  auto types = SantaEventTypeSet().set(type);
+
+  // skip the incomplete line being written, if any
+  size_t block_end = file_size;
+  while (block_end > 0 && data[block_end - 1] != '\n') {
+    --block_end;
+  }
+
+  bool covered = false;
+  while (block_end > 0 && !covered) {
+    // blocks start on a line boundary, they grow to fit longer lines
+    size_t block_start = (block_end > block_size) ? block_end - block_size : 0;
+    while (block_start > 0 && data[block_start - 1] != '\n') {
+      --block_start;
+    }
+
+    // Records whose path cannot match are skipped before they are parsed
+    std::string_view block_data(data + block_start, block_end - block_start);
+    DecisionStore block;
+    source.decode(block_data,
+                  types,
+                  filter.path_matcher.get(),
+                  [&block](SantaEventType, const LogEntryView& entry) {
+                    block.add(entry);
+                  });
+
+    // The log is written in time order: once a block reaches past the start
+    // of the window, so does everything before it
+    auto block_start_time = source.getFirstRecordTime(block_data);
+    covered = block_start_time != 0 && block_start_time < filter.min_time;
+    for (auto time : block.times()) {
+      if (time != 0 && time < filter.min_time) {
+        covered = true;
+        break;
+      }
+    }
+
+    LogEntries block_entries;
+    block.collect(block_entries, filter);
+    response.splice(response.begin(), block_entries);
+
+    if (filter.max_rows != 0 && response.size() >= filter.max_rows) {
+      while (response.size() > filter.max_rows) {
+        response.pop_front();
+      }
+
+      covered = true;
+    }
+
+    block_end = block_start;
+  }
+
+  munmap(mapping, file_size);
+  return covered;
+}
+
+// Tells whether the live log may hold events inside the filter's time
+// range, without reading it. Its entries were all written between its
+// creation and its last modification.
+bool currentLogInTimeRange(SantaEventType type,
+                           const DecisionFilter& filter,
+                           const LogSnapshot& snapshot) {
+  struct stat file_stat;
+  if (stat(FLAGS_santa_log_path.c_str(), &file_stat) != 0) {
+    return true;
+  }
+
+  if (filter.min_time > file_stat.st_mtime) {
+    return false;
+  }
+
+#if defined(__APPLE__)
+  if (filter.max_time < file_stat.st_birthtimespec.tv_sec) {
+    return false;
+  }
+#endif
+
+  // What we already parsed is a prefix of the file, so its first segment
+  // holds the oldest entries
+  if (file_stat.st_ino != current_log_checkpoint.inode ||
+      snapshot.current_log_segments.empty()) {
+    return true;
+  }
+
+  const auto& oldest_segment = *snapshot.current_log_segments.front();
+  auto partition_it = oldest_segment.find(type);
+  if (partition_it != oldest_segment.end() &&
+      partition_it->second.size() != 0 &&
+      filter.max_time < partition_it->second.minTime()) {
+    return false;
+  }
+
+  return true;
+}
+
+// Inflates a gzip archive through fixed-size input and output buffers, handing
+// each decompressed block to on_block as soon as it is produced. on_block may
+// return false to abort.
+bool inflateArchive(
+    const std::string& file_path,
+    const std::function<bool(const char* data, size_t size)>& on_block) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    VLOG(1) << "Failed to open compressed log file: " << file_path;
+    return false;
+  }
+
+  auto window_bits = std::min(std::max(FLAGS_santa_gzip_window_bits, 9), 15);
+  auto buffer_size = static_cast<size_t>(
+      std::max<std::uint64_t>(FLAGS_santa_gzip_buffer_size, 4096U));
+
+  z_stream stream = {};
+  // +16 selects the gzip wrapper
+  if (inflateInit2(&stream, window_bits + 16) != Z_OK) {
+    VLOG(1) << "Failed to initialize zlib for: " << file_path;
+    close(fd);
+    return false;
+  }
+
+  // Releases both however this returns, as on_block may throw
+  struct InflateResources final {
+    z_stream& stream;
+    int fd;
+
+    ~InflateResources() {
+      inflateEnd(&stream);
+      close(fd);
+    }
+  } resources{stream, fd};
+
+  std::vector<unsigned char> input(buffer_size);
+  std::vector<char> output(buffer_size);
+
+  bool succeeded = true;
+  int ret = Z_OK;
+  ssize_t num_read;
+  while (succeeded && (num_read = read(fd, input.data(), input.size())) > 0) {
+    scan_throttle.pace(FLAGS_santa_scan_cpu_limit);
+    if (scans_stopped) {
+      VLOG(1) << "Stopped reading compressed log file: " << file_path;
+      succeeded = false;
       break;
     }
 
-    val_end = line.find('|', val_pos);
-    values.emplace(line.substr(key_pos, key_end - key_pos),
-                   line.substr(val_pos, val_end - val_pos));
+    stream.next_in = input.data();
+    stream.avail_in = static_cast<uInt>(num_read);
 
-    key_pos = val_end;
-    if (key_pos != std::string::npos)
-      ++key_pos;
+    do {
+      // newsyslog only writes a single member, but gzip allows several
+      if (ret == Z_STREAM_END) {
+        if (stream.avail_in == 0) {
+          break;
+        }
+
+        if (inflateReset(&stream) != Z_OK) {
+          succeeded = false;
+          break;
+        }
+      }
+
+      stream.next_out = reinterpret_cast<Bytef*>(output.data());
+      stream.avail_out = static_cast<uInt>(output.size());
+
+      ret = inflate(&stream, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        VLOG(1) << "Error decompressing file " << file_path << ": "
+                << (stream.msg != nullptr ? stream.msg : "unknown error");
+        succeeded = false;
+        break;
+      }
+
+      if (!on_block(output.data(), output.size() - stream.avail_out)) {
+        succeeded = false;
+        break;
+      }
+    } while (stream.avail_in > 0 || stream.avail_out == 0);
+  }
+
+  if (num_read < 0) {
+    VLOG(1) << "Failed to read compressed log file: " << file_path;
+    succeeded = false;
+
+  } else if (succeeded && ret != Z_STREAM_END) {
+    // most likely an archive that newsyslog is still writing
+    VLOG(1) << "Truncated compressed log file: " << file_path;
+    succeeded = false;
   }
+
+  return succeeded;
 }
 
-void scrapeStream(std::istream& incoming,
-                  LogEntries& response,
-                  bool save_to_archive,
-                  SantaDecisionType decision) {
-  std::string line;
-  while (std::getline(incoming, line)) {
-    if (decision == kAllowed) {
-      // explicitly filter to only include ALLOW decisions
-      if (line.find("decision=ALLOW") == std::string::npos) {
-        continue;
+// Parses the archive on the calling thread as it is inflated. Memory use is
+// bounded by the inflate buffers (plus the longest line), whatever the archive
+// size.
+bool streamCompressedSantaLog(const std::string& file_path,
+                              EventPartitions& entries) {
+  std::string partial_record;
+  auto succeeded =
+      inflateArchive(file_path, [&](const char* data, size_t size) {
+        ingestBuffer(data, size, partial_record, entries);
+        return true;
+      });
+
+  if (!succeeded) {
+    return false;
+  }
+
+  if (!partial_record.empty()) {
+    ingestRecords(partial_record, entries);
+  }
+
+  return true;
+}
+
+// Inflating is sequential, so for large archives the other stages run
+// concurrently with it instead:
+//
+//   inflate thread -> [blocks] -> split (this thread) -> [record-aligned
+//   blocks] -> parse workers (filter + field extraction) -> merge in order
+//
+// Both queues are bounded, so a slow stage applies backpressure to the ones
+// before it and memory in flight stays at a few buffers. A stage that fails
+// closes both queues, which stops the others. An exception thrown by a stage
+// is rethrown once they all stopped.
+bool pipelineCompressedSantaLog(const std::string& file_path,
+                                EventPartitions& entries) {
+  struct RecordBlock final {
+    size_t sequence;
+    std::string data;
+  };
+
+  const size_t queue_capacity = 4U;
+  BoundedQueue<std::string> inflated_blocks(queue_capacity);
+  BoundedQueue<RecordBlock> record_blocks(queue_capacity);
+
+  // Stops and joins the stages however this thread leaves, so that no thread
+  // is left joinable if it throws
+  struct PipelineThreads final {
+    BoundedQueue<std::string>& inflated_blocks;
+    BoundedQueue<RecordBlock>& record_blocks;
+    std::vector<std::thread> threads;
+
+    ~PipelineThreads() {
+      join();
+    }
+
+    void join() {
+      inflated_blocks.close();
+      record_blocks.close();
+
+      for (auto& thread : threads) {
+        if (thread.joinable()) {
+          thread.join();
+        }
       }
-    } else /* if (decision == kDenied) */ {
-      // explicitly filter to only include DENY decisions
-      if (line.find("decision=DENY") == std::string::npos) {
-        continue;
+    }
+  };
+
+  std::mutex results_mutex;
+  std::map<size_t, EventPartitions> results;
+  std::atomic<bool> failed(false);
+  std::exception_ptr exception;
+
+  auto fail = [&](const char* stage, const std::exception& e) {
+    VLOG(1) << "Exception in the " << stage << " stage of " << file_path
+            << ": " << e.what();
+
+    {
+      std::lock_guard<std::mutex> lock(results_mutex);
+      if (!exception) {
+        exception = std::current_exception();
       }
     }
 
-    std::map<std::string, std::string> values;
-    extractValues(line, values);
+    failed = true;
+    inflated_blocks.close();
+    record_blocks.close();
+  };
+
+  auto parse_worker = [&]() {
+    try {
+      RecordBlock block;
+      while (record_blocks.pop(block)) {
+        scan_throttle.pace(FLAGS_santa_scan_cpu_limit);
+
+        EventPartitions block_entries;
+        ingestRecords(block.data, block_entries);
+
+        std::lock_guard<std::mutex> lock(results_mutex);
+        results.emplace(block.sequence, std::move(block_entries));
+      }
+
+    } catch (const std::exception& e) {
+      fail("parse", e);
+    }
+  };
+
+  auto parse_thread_count =
+      std::max<std::uint64_t>(FLAGS_santa_archive_pipeline_threads, 1U);
+
+  // Declared after everything the stages use, so that it joins them first
+  PipelineThreads pipeline{inflated_blocks, record_blocks, {}};
+  pipeline.threads.emplace_back([&]() {
+    try {
+      if (!inflateArchive(file_path, [&](const char* data, size_t size) {
+            return inflated_blocks.push(std::string(data, size));
+          })) {
+        failed = true;
+      }
+
+    } catch (const std::exception& e) {
+      fail("inflate", e);
+    }
+
+    inflated_blocks.close();
+  });
+
+  for (std::uint64_t i = 0; i < parse_thread_count; ++i) {
+    pipeline.threads.emplace_back(parse_worker);
+  }
+
+  // Cut the inflated stream after the last complete record of each block,
+  // carrying the rest over to the next one
+  const auto& source = getLogSource();
+  size_t sequence = 0;
+  std::string partial_record;
+  std::string block;
+  while (inflated_blocks.pop(block)) {
+    std::string records = std::move(partial_record);
+    records += block;
+
+    auto complete_size = source.getCompleteSize(records);
+    partial_record.assign(records, complete_size, std::string::npos);
+    records.resize(complete_size);
+
+    if (!records.empty() &&
+        !record_blocks.push({sequence++, std::move(records)})) {
+      break;
+    }
+  }
+
+  if (!partial_record.empty()) {
+    record_blocks.push({sequence++, std::move(partial_record)});
+  }
 
-    response.push_back({values["timestamp"],
-                        values["path"],
-                        values["reason"],
-                        values["sha256"]});
+  // Closing the queues lets the workers drain what is left before they exit
+  pipeline.join();
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
 
-    if (save_to_archive) {
-      archived_lines.push_back(line);
+  if (failed) {
+    return false;
+  }
+
+  for (auto& result : results) {
+    for (auto& partition : result.second) {
+      auto& destination = entries[partition.first];
+      destination.append(std::move(partition.second));
     }
   }
+
+  return true;
 }
 
-void scrapeCurrentLog(LogEntries& response, SantaDecisionType decision) {
-  response.clear();
+bool scrapeCompressedSantaLog(const std::string& file_path,
+                              off_t compressed_size,
+                              EventPartitions& entries) {
+  auto pipeline_min_size = FLAGS_santa_archive_pipeline_min_size;
+
+  bool succeeded;
+  if (pipeline_min_size != 0U &&
+      static_cast<std::uint64_t>(compressed_size) >= pipeline_min_size) {
+    // An archive that is truncated or fails to inflate would fail the same
+    // way again, only the pipeline's own failures are retried without it
+    try {
+      succeeded = pipelineCompressedSantaLog(file_path, entries);
+
+    } catch (const std::exception&) {
+      VLOG(1) << "Reading the compressed log file " << file_path
+              << " again without the pipeline";
+      succeeded = streamCompressedSantaLog(file_path, entries);
+    }
 
-  std::ifstream log_file;
-  log_file.open(kSantaLogPath);
-  if (!log_file.is_open()) {
-    return;
+  } else {
+    succeeded = streamCompressedSantaLog(file_path, entries);
+  }
+
+  if (succeeded) {
+    VLOG(1) << "Successfully processed compressed log file: " << file_path;
   }
 
-  scrapeStream(log_file, response, false, decision);
-  log_file.close();
+  return succeeded;
 }
 
-// Implementation using zlib to handle compressed log files
-bool scrapeCompressedSantaLog(std::string file_path,
-                              LogEntries& response,
-                              SantaDecisionType decision) {
-  gzFile gzfile = gzopen(file_path.c_str(), "rb");
-  if (!gzfile) {
-    VLOG(1) << "Failed to open compressed log file: " << file_path;
+// Parses an archive that is not compressed in place, through a read-only
+// mapping
+bool scrapeUncompressedSantaLog(const std::string& file_path,
+                                EventPartitions& entries) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    VLOG(1) << "Failed to open log file: " << file_path;
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+
+  if (file_stat.st_size == 0) {
+    close(fd);
+    return true;
+  }
+
+  auto file_size = static_cast<size_t>(file_stat.st_size);
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    VLOG(1) << "Failed to map log file " << file_path << ": "
+            << strerror(errno);
+    return false;
+  }
+
+  ingestRecordsInParallel(
+      std::string_view(static_cast<const char*>(mapping), file_size), entries);
+
+  munmap(mapping, file_size);
+  VLOG(1) << "Successfully processed log file: " << file_path;
+  return true;
+}
+
+bool getArchiveFingerprint(const std::string& file_path,
+                           ArchiveFingerprint& fingerprint) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
     return false;
   }
 
+  unsigned char head[kArchiveFingerprintBlockSize];
+  ssize_t num_read = pread(fd, head, sizeof(head), 0);
+  close(fd);
+
+  if (num_read < 0) {
+    return false;
+  }
+
+  fingerprint.inode = file_stat.st_ino;
+  fingerprint.size = file_stat.st_size;
+  fingerprint.mtime = file_stat.st_mtime;
+  fingerprint.head_crc = static_cast<std::uint32_t>(
+      crc32(crc32(0L, Z_NULL, 0), head, static_cast<uInt>(num_read)));
+
+  return true;
+}
+
+struct ArchiveScan final {
+  std::string path;
+  ArchiveFingerprint fingerprint;
+  SharedPartitions entries;
+};
+
+// Adds a denial to the heavy hitters of its day. The caller holds
+// heavy_hitters_mutex.
+void countDenial(std::string_view sha256, std::int64_t time) {
+  const std::int64_t kSecondsPerDay = 86400;
+  if (time <= 0 || sha256.empty()) {
+    return;
+  }
+
+  auto days = static_cast<std::int64_t>(
+      std::max<std::uint64_t>(FLAGS_santa_topk_days, 1U));
+  auto day = time / kSecondsPerDay;
+  if (!denied_heavy_hitters.empty() &&
+      day <= denied_heavy_hitters.rbegin()->first - days) {
+    return;
+  }
+
+  auto day_it = denied_heavy_hitters.find(day);
+  if (day_it == denied_heavy_hitters.end()) {
+    day_it = denied_heavy_hitters
+                 .emplace(day,
+                          HeavyHitters(FLAGS_santa_topk_size,
+                                       FLAGS_santa_topk_sketch_width,
+                                       FLAGS_santa_topk_sketch_depth))
+                 .first;
+
+    auto newest_day = denied_heavy_hitters.rbegin()->first;
+    while (denied_heavy_hitters.begin()->first <= newest_day - days) {
+      denied_heavy_hitters.erase(denied_heavy_hitters.begin());
+    }
+  }
+
+  day_it->second.add(sha256);
+}
+
+// Counts the denials that were not counted yet. Runs before retention, so
+// that whatever is read is counted even if it is not kept.
+void countNewDenials(const std::vector<ArchiveScan>& archives,
+                     const std::set<ArchiveFingerprint>& evicted,
+                     const std::vector<SharedPartitions>& current_log_segments) {
+  std::lock_guard<std::mutex> lock(heavy_hitters_mutex);
+  auto& count = denial_count;
+
+  // Counts the entries of one log file, in order, that come after the last
+  // one counted
+  auto make_counter = [&count]() {
+    return [&count, seen = size_t(0)](std::string_view sha256,
+                                      std::int64_t time) mutable {
+      if (time < count.last_time) {
+        return;
+      }
+
+      if (time > count.last_time) {
+        count.last_time = time;
+        count.last_time_count = 0;
+        seen = 0;
+      }
+
+      if (++seen > count.last_time_count) {
+        ++count.last_time_count;
+        countDenial(sha256, time);
+      }
+    };
+  };
+
+  // Oldest archive first, for the entries to come in time order
+  std::set<ArchiveFingerprint> listed_archives = evicted;
+  for (auto archive_it = archives.rbegin(); archive_it != archives.rend();
+       ++archive_it) {
+    listed_archives.insert(archive_it->fingerprint);
+    if (!archive_it->entries ||
+        !count.archives.insert(archive_it->fingerprint).second) {
+      continue;
+    }
+
+    auto partition_it = archive_it->entries->find(kDenied);
+    if (partition_it == archive_it->entries->end()) {
+      continue;
+    }
+
+    auto count_new = make_counter();
+    partition_it->second.forEachSha256Since(
+        std::numeric_limits<std::int64_t>::min(),
+        [&](std::string_view sha256, std::int64_t time) {
+          if (time < count.live_log_start) {
+            countDenial(sha256, time);
+          } else {
+            count_new(sha256, time);
+          }
+        });
+  }
+
+  for (auto archive_it = count.archives.begin();
+       archive_it != count.archives.end();) {
+    archive_it = (listed_archives.count(*archive_it) == 0)
+                     ? count.archives.erase(archive_it)
+                     : std::next(archive_it);
+  }
+
+  // Only the newest live log segments can hold entries not counted yet
+  auto segment_it = current_log_segments.end();
+  while (segment_it != current_log_segments.begin()) {
+    const auto& segment = **std::prev(segment_it);
+    auto partition_it = segment.find(kDenied);
+    if (partition_it != segment.end() && partition_it->second.size() != 0 &&
+        partition_it->second.maxTime() < count.last_time) {
+      break;
+    }
+
+    --segment_it;
+  }
+
+  auto count_new = make_counter();
+  for (; segment_it != current_log_segments.end(); ++segment_it) {
+    auto partition_it = (*segment_it)->find(kDenied);
+    if (partition_it == (*segment_it)->end()) {
+      continue;
+    }
+
+    partition_it->second.forEachSha256Since(
+        count.last_time,
+        [&](std::string_view sha256, std::int64_t time) {
+          if (count.live_log_start == std::numeric_limits<std::int64_t>::max()) {
+            count.live_log_start = time;
+          }
+
+          count_new(sha256, time);
+        });
+  }
+}
+
+// Returns a compact copy of the entries that are not older than time
+SharedPartitions copyPartitionsSince(const EventPartitions& partitions,
+                                     std::int64_t time) {
+  auto copy = std::make_shared<EventPartitions>();
+  for (const auto& partition : partitions) {
+    (*copy)[partition.first] = partition.second.copySince(time);
+  }
+
+  return copy;
+}
+
+// Keeps about the newest row_count entries of a log file, across all of its
+// partitions
+SharedPartitions keepNewestRows(const SharedPartitions& partitions,
+                                size_t row_count) {
+  if (row_count == 0) {
+    return std::make_shared<EventPartitions>();
+  }
+
+  std::vector<std::int64_t> times;
+  for (const auto& partition : *partitions) {
+    const auto& store_times = partition.second.times();
+    times.insert(times.end(), store_times.begin(), store_times.end());
+  }
+
+  if (row_count >= times.size()) {
+    return partitions;
+  }
+
+  std::nth_element(times.begin(),
+                   times.begin() + (row_count - 1),
+                   times.end(),
+                   std::greater<std::int64_t>());
+
+  return copyPartitionsSince(*partitions, times[row_count - 1]);
+}
+
+// Holds the cached entries of the given log files, ordered newest first,
+// within the retention limits. Entries past the age limit are dropped; then
+// the file that crosses the row or byte limit keeps only its newest entries
+// and every older file is emptied. Files are replaced rather than modified,
+// since published snapshots may share them. Returns the number of files left
+// holding entries.
+size_t applyRetention(std::vector<SharedPartitions>& sources) {
+  if (FLAGS_santa_retention_max_age > 0) {
+    auto oldest_kept =
+        static_cast<std::int64_t>(std::time(nullptr)) -
+        static_cast<std::int64_t>(FLAGS_santa_retention_max_age);
+
+    for (auto& partitions : sources) {
+      auto expired = std::any_of(
+          partitions->begin(), partitions->end(), [&](const auto& partition) {
+            return partition.second.size() != 0 &&
+                   partition.second.minTime() < oldest_kept;
+          });
+
+      if (expired) {
+        partitions = copyPartitionsSince(*partitions, oldest_kept);
+      }
+    }
+  }
+
+  auto max_rows = (FLAGS_santa_retention_max_rows > 0)
+                      ? static_cast<size_t>(FLAGS_santa_retention_max_rows)
+                      : std::numeric_limits<size_t>::max();
+  auto max_bytes = (FLAGS_santa_retention_max_bytes > 0)
+                       ? static_cast<size_t>(FLAGS_santa_retention_max_bytes)
+                       : std::numeric_limits<size_t>::max();
+
+  size_t total_rows = 0;
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < sources.size(); ++i) {
+    auto rows = getRowCount(*sources[i]);
+    auto bytes = getMemoryUsage(*sources[i]);
+    if (rows <= max_rows - total_rows && bytes <= max_bytes - total_bytes) {
+      total_rows += rows;
+      total_bytes += bytes;
+      continue;
+    }
+
+    // Entries of one file take about the same room each, but a store also
+    // has fixed costs, so the estimate is refined until the file fits
+    auto kept_rows = std::min(rows, max_rows - total_rows);
+    auto kept = keepNewestRows(sources[i], kept_rows);
+
+    for (int attempt = 0; attempt < 4 && kept_rows > 0; ++attempt) {
+      bytes = getMemoryUsage(*kept);
+      if (bytes <= max_bytes - total_bytes) {
+        break;
+      }
+
+      kept_rows = std::min(
+          kept_rows - 1,
+          static_cast<size_t>(static_cast<double>(max_bytes - total_bytes) /
+                              static_cast<double>(bytes) *
+                              static_cast<double>(kept_rows)));
+      kept = keepNewestRows(sources[i], kept_rows);
+    }
+
+    sources[i] = std::move(kept);
+    for (size_t j = i + 1; j < sources.size(); ++j) {
+      sources[j] = std::make_shared<EventPartitions>();
+    }
+
+    return kept_rows > 0 ? i + 1 : i;
+  }
+
+  return sources.size();
+}
+
+// Fills the snapshot's archives from the index file, the first time the logs
+// are scanned after the extension started
+void loadArchiveIndexOnce(LogSnapshot& snapshot) {
+  static bool attempted = false;
+  if (attempted) {
+    return;
+  }
+
+  attempted = true;
+  if (!FLAGS_santa_archive_index) {
+    return;
+  }
+
+  ArchiveCache archives;
+  if (loadArchiveIndex(FLAGS_santa_archive_index_path,
+                       partitioned_event_types,
+                       archives,
+                       evicted_archives)) {
+    snapshot.archives.assign(archives.begin(), archives.end());
+  }
+}
+
+void saveArchiveIndexIfEnabled(const LogSnapshot& snapshot) {
+  if (!FLAGS_santa_archive_index) {
+    return;
+  }
+
+  ArchiveCache archives(snapshot.archives.begin(), snapshot.archives.end());
+  saveArchiveIndex(FLAGS_santa_archive_index_path,
+                   partitioned_event_types,
+                   archives,
+                   evicted_archives);
+}
+
+std::set<ArchiveFingerprint> getArchiveFingerprints(
+    const LogSnapshot& snapshot) {
+  std::set<ArchiveFingerprint> fingerprints;
+  for (const auto& archive : snapshot.archives) {
+    fingerprints.insert(archive.first);
+  }
+
+  return fingerprints;
+}
+
+// Brings the log files the query needs up to date and publishes the result
+// as a new snapshot. Refreshes run one at a time; the snapshot being replaced
+// stays valid for the queries still reading it.
+std::shared_ptr<const LogSnapshot> refreshSnapshot(
+    SantaEventType type, const DecisionFilter& filter) {
+  std::lock_guard<std::mutex> lock(writer_mutex);
+
+  auto previous = std::atomic_load(&current_snapshot);
+  LogSnapshot next = *previous;
+  loadArchiveIndexOnce(next);
+
+  auto previous_archives = getArchiveFingerprints(next);
+  auto previous_evicted_archives = evicted_archives;
+
+  // A type that was not kept so far is missing from everything parsed, which
+  // is dropped and read again
+  if (!partitioned_event_types.test(type)) {
+    partitioned_event_types.set(type);
+    resetCurrentLog(0, next);
+    next.archives.clear();
+  }
+
+  const auto& source = getLogSource();
+  if (source.hasLiveLog()) {
+    dropRotatedCurrentLog(next);
+    if (currentLogInTimeRange(type, filter, next)) {
+      tailCurrentLog(next);
+    }
+  }
+
+  // The archives can take a while. Queries that run out of time meanwhile
+  // get the live log as it is now.
+  if (next.current_log_segments != previous->current_log_segments ||
+      next.archives != previous->archives) {
+    std::atomic_store(&current_snapshot,
+                      std::make_shared<const LogSnapshot>(next));
+  }
+
+  // Collect the archives newest to oldest, picking up the ones we have seen
+  // before. Archives past the retention limits are only remembered as such.
+  std::map<ArchiveFingerprint, SharedPartitions> cached_archives(
+      next.archives.begin(), next.archives.end());
+
+  std::vector<ArchiveScan> archives;
+  std::set<ArchiveFingerprint> new_evicted_archives;
+  for (auto& archive_path : source.listArchives()) {
+    ArchiveScan archive;
+    archive.path = std::move(archive_path);
+    if (!getArchiveFingerprint(archive.path, archive.fingerprint)) {
+      continue;
+    }
+
+    if (!new_evicted_archives.empty() ||
+        evicted_archives.count(archive.fingerprint) != 0) {
+      new_evicted_archives.insert(archive.fingerprint);
+      continue;
+    }
+
+    auto cache_it = cached_archives.find(archive.fingerprint);
+    if (cache_it != cached_archives.end()) {
+      archive.entries = cache_it->second;
+    }
+
+    archives.push_back(std::move(archive));
+  }
+
+  // Read the new ones on the worker pool. An archive was last written to
+  // when it was rotated, so its mtime bounds the time of its entries and
+  // archives entirely older than the query's time range, or than the
+  // retention age, can be left alone.
+  auto min_time = filter.min_time;
+  if (FLAGS_santa_retention_max_age > 0) {
+    min_time = std::max(
+        min_time,
+        static_cast<std::int64_t>(std::time(nullptr)) -
+            static_cast<std::int64_t>(FLAGS_santa_retention_max_age));
+  }
+
+  std::vector<std::function<void()>> tasks;
+  for (auto& archive : archives) {
+    if (!archive.entries && archive.fingerprint.mtime >= min_time) {
+      tasks.push_back([&archive, &source]() {
+        EventPartitions entries;
+        auto succeeded =
+            source.archivesCompressed()
+                ? scrapeCompressedSantaLog(
+                      archive.path, archive.fingerprint.size, entries)
+                : scrapeUncompressedSantaLog(archive.path, entries);
+
+        if (succeeded) {
+          archive.entries = std::make_shared<EventPartitions>(std::move(entries));
+        }
+      });
+    }
+  }
+
+  runInParallel(tasks, FLAGS_santa_archive_threads);
+
+  if (partitioned_event_types.test(kDenied)) {
+    countNewDenials(archives, new_evicted_archives, next.current_log_segments);
+  }
+
+  // Live log segments newest first, then the archives
+  std::vector<SharedPartitions> sources(next.current_log_segments.rbegin(),
+                                        next.current_log_segments.rend());
+  auto segment_count = sources.size();
+
+  std::vector<ArchiveScan*> scanned_archives;
+  for (auto& archive : archives) {
+    if (archive.entries) {
+      sources.push_back(archive.entries);
+      scanned_archives.push_back(&archive);
+    }
+  }
+
+  auto retained_sources = applyRetention(sources);
+
+  next.current_log_segments.clear();
+  for (size_t i = segment_count; i > 0; --i) {
+    if (getRowCount(*sources[i - 1]) != 0) {
+      next.current_log_segments.push_back(sources[i - 1]);
+    }
+  }
+
+  next.archives.clear();
+  for (size_t i = 0; i < scanned_archives.size(); ++i) {
+    const auto& fingerprint = scanned_archives[i]->fingerprint;
+    if (segment_count + i < retained_sources) {
+      next.archives.emplace_back(fingerprint, sources[segment_count + i]);
+    } else {
+      new_evicted_archives.insert(fingerprint);
+    }
+  }
+
+  evicted_archives = std::move(new_evicted_archives);
+
+  auto snapshot = std::make_shared<const LogSnapshot>(std::move(next));
+  std::atomic_store(&current_snapshot, snapshot);
+
+  if (previous_archives != getArchiveFingerprints(*snapshot) ||
+      previous_evicted_archives != evicted_archives) {
+    saveArchiveIndexIfEnabled(*snapshot);
+  }
+
+  return snapshot;
+}
+
+// The refresh running on a background thread, if any. stopSantaLogScans()
+// waits for it before the extension exits, while everything it uses, the
+// function-local statics included, is still there.
+std::mutex background_refresh_mutex;
+std::shared_future<void> background_refresh;
+
+// Refreshes the snapshot for a query on a background thread, and waits for it
+// within the query's budget. Returns false when the budget ran out first; the
+// refresh then carries on, and later queries find its results.
+bool waitForRefresh(SantaEventType type, const DecisionFilter& filter) {
+  static const std::chrono::milliseconds kPollInterval(10);
+
+  auto time_limit = std::chrono::milliseconds(FLAGS_santa_query_time_budget);
+  auto cpu_limit = std::chrono::milliseconds(FLAGS_santa_query_cpu_budget);
+  ScanBudget budget(time_limit, cpu_limit);
+
+  // A refresh that is already running was started for another query, which
+  // may want another type or time range: wait for it, then run our own
+  for (;;) {
+    std::shared_future<void> refresh;
+    bool started = false;
+    {
+      std::lock_guard<std::mutex> lock(background_refresh_mutex);
+      if (scans_stopped) {
+        return false;
+      }
+
+      if (!background_refresh.valid() ||
+          background_refresh.wait_for(std::chrono::seconds(0)) ==
+              std::future_status::ready) {
+        background_refresh =
+            std::async(std::launch::async, [type, filter]() {
+              refreshSnapshot(type, filter);
+            }).share();
+        started = true;
+      }
+
+      refresh = background_refresh;
+    }
+
+    while (refresh.wait_for(kPollInterval) != std::future_status::ready) {
+      if (budget.exhausted()) {
+        VLOG(1) << "The Santa log scan is over budget, returning partial "
+                   "results";
+        return false;
+      }
+    }
+
+    if (started) {
+      // rethrows whatever the refresh threw
+      refresh.get();
+      return true;
+    }
+  }
+}
+
+void stopSantaLogScans() {
+  scans_stopped = true;
+
+  std::shared_future<void> refresh;
+  {
+    std::lock_guard<std::mutex> lock(background_refresh_mutex);
+    refresh = background_refresh;
+  }
+
+  if (refresh.valid()) {
+    refresh.wait();
+  }
+}
+
+bool scrapeSantaLog(LogEntries& response,
+                    SantaEventType type,
+                    const DecisionFilter& filter,
+                    bool& truncated) {
+  truncated = false;
+
   try {
-    char buffer[8192];
-    std::stringstream decompressed_content;
-    
-    int num_read = 0;
-    while ((num_read = gzread(gzfile, buffer, sizeof(buffer))) > 0) {
-      decompressed_content.write(buffer, num_read);
+    if (filter.read_backwards &&
+        scrapeCurrentLogBackwards(response, type, filter)) {
+      return true;
     }
-    
-    // Check for errors
-    int err;
-    const char* error_string = gzerror(gzfile, &err);
-    if (err != Z_OK && err != Z_STREAM_END) {
-      VLOG(1) << "Error decompressing file: " << error_string;
-      gzclose(gzfile);
-      return false;
+
+    truncated = !waitForRefresh(type, filter);
+    auto snapshot = std::atomic_load(&current_snapshot);
+
+    // The snapshot is immutable, so this needs no locking. It is read newest
+    // first, which is where a row limit cuts it short.
+    std::vector<const EventPartitions*> sources;
+    for (auto segment_it = snapshot->current_log_segments.rbegin();
+         segment_it != snapshot->current_log_segments.rend();
+         ++segment_it) {
+      sources.push_back(segment_it->get());
     }
-    
-    // Close the file
-    gzclose(gzfile);
-    
-    // Process the decompressed content
-    std::istringstream stream(decompressed_content.str());
-    scrapeStream(stream, response, true, decision);
-    
-    VLOG(1) << "Successfully processed compressed log file: " << file_path;
+
+    auto segment_count = sources.size();
+    for (const auto& archive : snapshot->archives) {
+      sources.push_back(archive.second.get());
+    }
+
+    std::vector<LogEntries> source_entries(sources.size());
+    size_t row_count = 0;
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (filter.max_rows != 0 && row_count == filter.max_rows) {
+        break;
+      }
+
+      auto partition_it = sources[i]->find(type);
+      if (partition_it == sources[i]->end()) {
+        continue;
+      }
+
+      auto& entries = source_entries[i];
+      partition_it->second.collect(entries, filter);
+      if (filter.max_rows != 0) {
+        while (row_count + entries.size() > filter.max_rows) {
+          entries.pop_front();
+        }
+      }
+
+      row_count += entries.size();
+    }
+
+    // The live log comes first, then the archives newest to oldest
+    response.clear();
+    for (size_t i = segment_count; i > 0; --i) {
+      response.splice(response.end(), source_entries[i - 1]);
+    }
+
+    for (size_t i = segment_count; i < sources.size(); ++i) {
+      response.splice(response.end(), source_entries[i]);
+    }
+
     return true;
+
   } catch (const std::exception& e) {
-    VLOG(1) << "Failed to decompress log file: " << e.what();
-    gzclose(gzfile);
+    VLOG(1) << "Failed to read the Santa log files: " << e.what();
     return false;
   }
 }
 
-bool newArchiveFileExists() {
-  std::stringstream strstr;
-  strstr << kSantaLogPath << "." << next_oldest_archive << ".gz";
-  std::ifstream file(strstr.str(), std::ios_base::in | std::ios_base::binary);
-  return file.is_open();
-}
+bool summarizeSantaDecisions(DecisionSummaries& response,
+                             SantaEventType type,
+                             const DecisionFilter& filter,
+                             bool& truncated) {
+  truncated = false;
+
+  try {
+    truncated = !waitForRefresh(type, filter);
+    auto snapshot = std::atomic_load(&current_snapshot);
+
+    // Newest first, for the reasons of decisions logged in the same second
+    response.clear();
+    auto summarize = [&](const EventPartitions& partitions) {
+      auto partition_it = partitions.find(type);
+      if (partition_it != partitions.end()) {
+        partition_it->second.summarize(response, filter);
+      }
+    };
+
+    for (auto segment_it = snapshot->current_log_segments.rbegin();
+         segment_it != snapshot->current_log_segments.rend();
+         ++segment_it) {
+      summarize(**segment_it);
+    }
+
+    for (const auto& archive : snapshot->archives) {
+      summarize(*archive.second);
+    }
+
+    return true;
 
-void processArchivedLines(LogEntries& response) {
-  for (std::list<std::string>::const_iterator iter = archived_lines.begin();
-       iter != archived_lines.end();
-       ++iter) {
-    std::map<std::string, std::string> values;
-    extractValues(*iter, values);
-    response.push_back({values["timestamp"],
-                        values["path"],
-                        values["reason"],
-                        values["sha256"]});
+  } catch (const std::exception& e) {
+    VLOG(1) << "Failed to read the Santa log files: " << e.what();
+    return false;
   }
 }
 
-bool scrapeSantaLog(LogEntries& response, SantaDecisionType decision) {
+bool getTopDeniedBinaries(DeniedBinaries& response,
+                          std::uint64_t days,
+                          bool& truncated) {
+  const std::int64_t kSecondsPerDay = 86400;
+  truncated = false;
+  response.clear();
+
   try {
-    scrapeCurrentLog(response, decision);
+    truncated = !waitForRefresh(kDenied, DecisionFilter());
 
-    // if there are no new archived files, just process our stash
-    if (!newArchiveFileExists()) {
-      processArchivedLines(response);
+    std::lock_guard<std::mutex> lock(heavy_hitters_mutex);
+    if (denied_heavy_hitters.empty()) {
       return true;
     }
 
-    // rolling archive files--clear the stored archive and reprocess them all
-    archived_lines.clear();
-    for (unsigned int i = 0;; ++i) {
-      next_oldest_archive = i;
+    // The last days up to today, or up to the newest denial if the log runs
+    // ahead of the clock
+    auto last_day = std::max<std::int64_t>(
+        std::time(nullptr) / kSecondsPerDay,
+        denied_heavy_hitters.rbegin()->first);
+    auto first_day = (days == 0)
+                         ? std::numeric_limits<std::int64_t>::min()
+                         : last_day - static_cast<std::int64_t>(days) + 1;
+
+    // Sketches add up, and a binary among the most denied over several days
+    // is among the most denied of at least one of them
+    std::unique_ptr<CountMinSketch> sketch;
+    std::set<std::string> candidates;
+    for (auto day_it = denied_heavy_hitters.lower_bound(first_day);
+         day_it != denied_heavy_hitters.end();
+         ++day_it) {
+      if (!sketch) {
+        sketch = std::make_unique<CountMinSketch>(day_it->second.sketch());
+      } else {
+        sketch->merge(day_it->second.sketch());
+      }
 
-      std::stringstream strstr;
-      strstr << kSantaLogPath << "." << i << ".gz";
-      if (!scrapeCompressedSantaLog(strstr.str(), response, decision)) {
-        break;
+      for (auto& key : day_it->second.keys()) {
+        candidates.insert(std::move(key));
       }
     }
 
+    if (!sketch) {
+      return true;
+    }
+
+    auto error_bound = static_cast<std::uint64_t>(std::ceil(
+        sketch->errorRate() * static_cast<double>(sketch->total())));
+    for (const auto& candidate : candidates) {
+      response.push_back({candidate,
+                          sketch->estimate(candidate),
+                          error_bound,
+                          sketch->confidence()});
+    }
+
+    std::sort(response.begin(),
+              response.end(),
+              [](const DeniedBinary& first, const DeniedBinary& second) {
+                return first.count > second.count ||
+                       (first.count == second.count &&
+                        first.sha256 < second.sha256);
+              });
+
+    if (response.size() > FLAGS_santa_topk_size) {
+      response.resize(FLAGS_santa_topk_size);
+    }
+
     return true;
 
   } catch (const std::exception& e) {
@@ -200,6 +1633,48 @@ bool scrapeSantaLog(LogEntries& response, SantaDecisionType decision) {
   }
 }
 
+void getDecisionCacheUsage(DecisionCacheUsage& usage) {
+  usage = {};
+  usage.max_age = FLAGS_santa_retention_max_age;
+  usage.max_rows = FLAGS_santa_retention_max_rows;
+  usage.max_bytes = FLAGS_santa_retention_max_bytes;
+
+  auto min_time = std::numeric_limits<std::int64_t>::max();
+  auto max_time = std::numeric_limits<std::int64_t>::min();
+
+  auto add_partitions = [&](const EventPartitions& partitions) {
+    usage.rows += getRowCount(partitions);
+    usage.bytes += getMemoryUsage(partitions);
+
+    for (const auto& partition : partitions) {
+      if (partition.second.size() != 0) {
+        min_time = std::min(min_time, partition.second.minTime());
+        max_time = std::max(max_time, partition.second.maxTime());
+      }
+    }
+  };
+
+  auto snapshot = std::atomic_load(&current_snapshot);
+  if (!snapshot->current_log_segments.empty()) {
+    ++usage.files;
+    for (const auto& segment : snapshot->current_log_segments) {
+      add_partitions(*segment);
+    }
+  }
+
+  for (const auto& archive : snapshot->archives) {
+    if (getRowCount(*archive.second) != 0) {
+      ++usage.files;
+      add_partitions(*archive.second);
+    }
+  }
+
+  if (usage.rows != 0) {
+    usage.min_time = min_time;
+    usage.max_time = max_time;
+  }
+}
+
 static int rulesCallback(void* context,
                          int argc,
                          char** argv,
@@ -282,33 +1757,16 @@ bool collectSantaRules(RuleEntries& response) {
   // Verbose logging to track progress
   VLOG(1) << "Attempting to collect Santa rules from database: " << kSantaDatabasePath;
 
-  // make a copy of the rules db (santa keeps the db locked)
-  std::ifstream src(kSantaDatabasePath, std::ios_base::binary);
-  if (!src.is_open()) {
+  // Santa keeps the database locked, so it is read into memory, together
+  // with the changes still in its write-ahead log
+  DatabaseSnapshot snapshot;
+  if (!snapshot.open(kSantaDatabasePath)) {
     VLOG(1) << "Failed to access the Santa rule database at: " << kSantaDatabasePath;
     return false;
   }
 
-  std::ofstream dst(kTemporaryDatabasePath,
-                    std::ios_base::binary | std::ios_base::trunc);
-
-  if (!dst.is_open()) {
-    VLOG(1) << "Failed to create temporary database at: " << kTemporaryDatabasePath;
-    return false;
-  }
-
-  dst << src.rdbuf();
-  src.close();
-  dst.close();
-
-  // Open the database copy and enumerate the rules
-  sqlite3* db;
-  int rc = sqlite3_open(kTemporaryDatabasePath.c_str(), &db);
-  if (SQLITE_OK != rc) {
-    VLOG(1) << "Failed to open the temporary Santa rule database: " 
-            << sqlite3_errmsg(db);
-    return false;
-  }
+  sqlite3* db = snapshot.get();
+  int rc;
 
   // First, check the database schema to see what columns are available
   char* schema_error = nullptr;
@@ -330,7 +1788,6 @@ bool collectSantaRules(RuleEntries& response) {
     if (schema_error) {
       sqlite3_free(schema_error);
     }
-    sqlite3_close(db);
     return false;
   }
   
@@ -364,7 +1821,6 @@ bool collectSantaRules(RuleEntries& response) {
     VLOG(1) << "Using 'shasum' column for rule identifier";
   } else {
     VLOG(1) << "Could not find a valid identifier column in the schema";
-    sqlite3_close(db);
     return false;
   }
 
@@ -388,13 +1844,43 @@ bool collectSantaRules(RuleEntries& response) {
     sqlite3_free(sqlite_error_message);
   }
 
-  rc = sqlite3_close(db);
-  if (rc != SQLITE_OK) {
-    VLOG(1) << "Failed to close the Santa rule database";
-  }
-  
   VLOG(1) << "Collected " << response.size() << " rules from Santa database";
-  return (rc == SQLITE_OK);
+  return true;
+}
+
+FileState getFileState(const std::string& path) {
+  FileState state;
+
+  struct stat file_stat;
+  if (stat(path.c_str(), &file_stat) != 0) {
+    return state;
+  }
+
+  const std::int64_t kNanosecondsPerSecond = 1000000000;
+
+  state.exists = true;
+  state.inode = file_stat.st_ino;
+  state.size = file_stat.st_size;
+#if defined(__APPLE__)
+  state.mtime_ns = file_stat.st_mtimespec.tv_sec * kNanosecondsPerSecond +
+                   file_stat.st_mtimespec.tv_nsec;
+  state.ctime_ns = file_stat.st_ctimespec.tv_sec * kNanosecondsPerSecond +
+                   file_stat.st_ctimespec.tv_nsec;
+#else
+  state.mtime_ns = file_stat.st_mtim.tv_sec * kNanosecondsPerSecond +
+                   file_stat.st_mtim.tv_nsec;
+  state.ctime_ns = file_stat.st_ctim.tv_sec * kNanosecondsPerSecond +
+                   file_stat.st_ctim.tv_nsec;
+#endif
+
+  return state;
+}
+
+RulesFingerprint getSantaRulesFingerprint() {
+  RulesFingerprint fingerprint;
+  fingerprint.database = getFileState(kSantaDatabasePath);
+  fingerprint.wal = getFileState(kSantaDatabasePath + "-wal");
+  return fingerprint;
 }
 
 const char* getRuleTypeName(RuleEntry::Type type) {
@@ -1,18 +1,110 @@
 #pragma once
 
+#include <sys/types.h>
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <list>
+#include <memory>
+#include <set>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "pathmatcher.h"
 
-enum SantaDecisionType {
+// The kinds of events Santa logs. Executions are told apart by their
+// decision, every other kind by its action.
+enum SantaEventType {
   kAllowed,
   kDenied,
+  kFork,
+  kExit,
+  kWrite,
+  kRename,
+  kLink,
+  kDelete,
+  kDiskAppear,
+  kDiskDisappear,
+  kAllowlist,
+  kSantaEventTypeCount,
+};
+
+using SantaEventTypeSet = std::bitset<kSantaEventTypeCount>;
+
+// A key=value field of a Santa decision log line, and the decision table
+// column it is reported in
+struct LogFieldDescriptor final {
+  // Sha256 fields are reported as text but kept as 32 binary bytes
+  enum class Type { Text, Integer, Sha256 };
+
+  std::string_view key;
+  std::string_view column;
+  Type type;
+  bool indexed; // point lookups on the column go through an index
+};
+
+// Every field the decision tables know about, in column order. Both the
+// table schema and the log parser are generated from this list.
+// clang-format off
+constexpr std::array<LogFieldDescriptor, 17> kLogFields = {{
+  {"path",        "path",        LogFieldDescriptor::Type::Text,    true},
+  {"sha256",      "shasum",      LogFieldDescriptor::Type::Sha256,  true},
+  {"reason",      "reason",      LogFieldDescriptor::Type::Text,    false},
+  {"explain",     "explain",     LogFieldDescriptor::Type::Text,    false},
+  {"cert_sha256", "cert_sha256", LogFieldDescriptor::Type::Sha256,  false},
+  {"cert_cn",     "cert_cn",     LogFieldDescriptor::Type::Text,    false},
+  {"teamid",      "team_id",     LogFieldDescriptor::Type::Text,    false},
+  {"signingid",   "signing_id",  LogFieldDescriptor::Type::Text,    false},
+  {"cdhash",      "cdhash",      LogFieldDescriptor::Type::Text,    false},
+  {"pid",         "pid",         LogFieldDescriptor::Type::Integer, false},
+  {"ppid",        "ppid",        LogFieldDescriptor::Type::Integer, false},
+  {"uid",         "uid",         LogFieldDescriptor::Type::Integer, false},
+  {"user",        "user",        LogFieldDescriptor::Type::Text,    false},
+  {"gid",         "gid",         LogFieldDescriptor::Type::Integer, false},
+  {"group",       "group",       LogFieldDescriptor::Type::Text,    false},
+  {"mode",        "mode",        LogFieldDescriptor::Type::Text,    false},
+  {"args",        "args",        LogFieldDescriptor::Type::Text,    false},
+}};
+// clang-format on
+
+constexpr size_t kLogFieldCount = kLogFields.size();
+
+// Position of a log key in kLogFields, or kLogFieldCount if unknown
+constexpr size_t getLogFieldIndex(std::string_view key) {
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    if (kLogFields[i].key == key) {
+      return i;
+    }
+  }
+
+  return kLogFieldCount;
+}
+
+constexpr size_t kLogFieldPath = getLogFieldIndex("path");
+constexpr size_t kLogFieldSha256 = getLogFieldIndex("sha256");
+constexpr size_t kLogFieldReason = getLogFieldIndex("reason");
+
+// A subset of kLogFields, by position
+using LogFieldSet = std::bitset<kLogFieldCount>;
+
+// A parsed log line, as views into the line itself. Only valid for as long as
+// the line's buffer is.
+struct LogEntryView final {
+  std::string_view timestamp;
+  std::int64_t time{0}; // timestamp in seconds since the epoch, 0 if invalid
+  std::array<std::string_view, kLogFieldCount> fields;
 };
 
 struct LogEntry final {
   std::string timestamp;
-  std::string application;
-  std::string reason;
-  std::string sha256;
+  std::int64_t time{0}; // timestamp in seconds since the epoch, 0 if invalid
+  std::array<std::string, kLogFieldCount> fields;
 };
 
 struct RuleEntry final {
@@ -33,6 +125,52 @@ struct RuleEntry final {
   std::string custom_message;
 };
 
+// Restricts the decisions returned by scrapeSantaLog(). An empty set leaves
+// its column unconstrained; the time bounds are inclusive. Fields outside of
+// the `fields` set are left empty in the returned entries.
+struct DecisionFilter final {
+  std::set<std::string> sha256s;
+  std::set<std::string> paths;
+
+  // LIKE and GLOB patterns the path has to match, if any
+  std::shared_ptr<const PathMatcher> path_matcher;
+
+  std::int64_t min_time{std::numeric_limits<std::int64_t>::min()};
+  std::int64_t max_time{std::numeric_limits<std::int64_t>::max()};
+  LogFieldSet fields{LogFieldSet().set()};
+
+  // Only the newest max_rows matching entries are returned, 0 for all of them
+  size_t max_rows{0};
+
+  // The query only wants the end of the log, which is then read backwards
+  // from its end instead of being cached in full first
+  bool read_backwards{false};
+};
+
+// The decisions of one type logged for one binary at one path
+struct DecisionSummary final {
+  std::string sha256;
+  std::string path;
+  std::uint64_t count{0};
+  std::int64_t first_seen{0}; // 0 if no entry has a valid timestamp
+  std::int64_t last_seen{0};
+  std::string reason; // of the last decision
+};
+
+// Summaries by sha256 and path, joined by a NUL character
+using DecisionSummaries = std::unordered_map<std::string, DecisionSummary>;
+
+// One of the most denied binaries. Its count is an estimate that is never too
+// low, and too high by at most error_bound with the given confidence.
+struct DeniedBinary final {
+  std::string sha256;
+  std::uint64_t count{0};
+  std::uint64_t error_bound{0};
+  double confidence{0.0};
+};
+
+using DeniedBinaries = std::vector<DeniedBinary>;
+
 using LogEntries = std::list<LogEntry>;
 using RuleEntries = std::list<RuleEntry>;
 
@@ -42,5 +180,85 @@ const char* getRuleStateName(RuleEntry::State state);
 RuleEntry::Type getTypeFromRuleName(const char* name);
 RuleEntry::State getStateFromRuleName(const char* name);
 
-bool scrapeSantaLog(LogEntries& response, SantaDecisionType decision);
-bool collectSantaRules(RuleEntries& response);
\ No newline at end of file
+// What the decision cache currently holds, and the limits it is held to. A
+// limit of 0 means none.
+struct DecisionCacheUsage final {
+  size_t files{0}; // log files with cached entries
+  size_t rows{0};
+  size_t bytes{0};
+  std::int64_t min_time{0};
+  std::int64_t max_time{0};
+
+  std::uint64_t max_age{0};
+  std::uint64_t max_rows{0};
+  std::uint64_t max_bytes{0};
+};
+
+void getDecisionCacheUsage(DecisionCacheUsage& usage);
+
+// Collects the decisions of one type matching the filter. A scan that does not
+// fit in the query's budget carries on in the background; the rows cached so
+// far are returned and truncated is set.
+bool scrapeSantaLog(LogEntries& response,
+                    SantaEventType type,
+                    const DecisionFilter& filter,
+                    bool& truncated);
+// Summarizes the decisions of one type by sha256 and path. Only the sha256
+// and path sets of the filter apply. Reads the same cache as scrapeSantaLog(),
+// within the same budget.
+bool summarizeSantaDecisions(DecisionSummaries& response,
+                             SantaEventType type,
+                             const DecisionFilter& filter,
+                             bool& truncated);
+
+// The most denied binaries over the last days (0 for every day kept), most
+// denied first. Counts every denial read since the extension started, in
+// fixed memory, whatever the cache retention.
+bool getTopDeniedBinaries(DeniedBinaries& response,
+                          std::uint64_t days,
+                          bool& truncated);
+
+// Stops the scans of the Santa log: no new one starts, and the one running in
+// the background is cut short and waited for. Called before the extension
+// exits, as the background scan uses static objects.
+void stopSantaLogScans();
+
+bool collectSantaRules(RuleEntries& response);
+
+// What stat tells about a file. Writing to the file changes its size or its
+// modification time, and replacing it changes its inode.
+struct FileState final {
+  bool exists{false};
+  ino_t inode{0};
+  off_t size{0};
+  std::int64_t mtime_ns{0};
+  std::int64_t ctime_ns{0};
+
+  bool operator==(const FileState& other) const {
+    return std::tie(exists, inode, size, mtime_ns, ctime_ns) ==
+           std::tie(other.exists,
+                    other.inode,
+                    other.size,
+                    other.mtime_ns,
+                    other.ctime_ns);
+  }
+};
+
+// The state of the Santa rule database, which changes whenever a change to the
+// rules is committed. Checkpoints change it too, without changing the rules.
+struct RulesFingerprint final {
+  FileState database;
+  FileState wal;
+
+  bool operator==(const RulesFingerprint& other) const {
+    return database == other.database && wal == other.wal;
+  }
+
+  bool operator!=(const RulesFingerprint& other) const {
+    return !(*this == other);
+  }
+};
+
+// Takes the fingerprint of the rule database. Cheap enough to be taken on
+// every query: two stat calls and no read.
+RulesFingerprint getSantaRulesFingerprint();
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "santacachetable.h"
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include "santa.h"
+
+osquery::TableColumns SantaCacheUsageTablePlugin::columns() const {
+  // clang-format off
+  return {
+      std::make_tuple("files",
+                      osquery::INTEGER_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("rows",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("bytes",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("min_time",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("max_time",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("max_age",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("max_rows",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("max_bytes",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT)
+  };
+  // clang-format on
+}
+
+osquery::TableRows SantaCacheUsageTablePlugin::generate(
+    osquery::QueryContext& request) {
+  DecisionCacheUsage usage;
+  getDecisionCacheUsage(usage);
+
+  osquery::DynamicTableRowHolder row;
+  row["files"] = std::to_string(usage.files);
+  row["rows"] = std::to_string(usage.rows);
+  row["bytes"] = std::to_string(usage.bytes);
+  row["min_time"] = std::to_string(usage.min_time);
+  row["max_time"] = std::to_string(usage.max_time);
+  row["max_age"] = std::to_string(usage.max_age);
+  row["max_rows"] = std::to_string(usage.max_rows);
+  row["max_bytes"] = std::to_string(usage.max_bytes);
+
+  osquery::TableRows result;
+  result.emplace_back(row);
+  return result;
+}
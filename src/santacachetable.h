@@ -0,0 +1,11 @@
+#pragma once
+
+#include <osquery/sdk/sdk.h>
+
+// A single row gauge of the memory held by the Santa decision cache
+class SantaCacheUsageTablePlugin final : public osquery::TablePlugin {
+ private:
+  osquery::TableColumns columns() const override;
+
+  osquery::TableRows generate(osquery::QueryContext& request) override;
+};
@@ -0,0 +1,61 @@
+#include "santadecisioneventstable.h"
+
+#include <string>
+
+#include <osquery/logger/logger.h>
+
+#include "santadecisionstable.h"
+
+osquery::Status SantaDecisionEventSubscriber::init() {
+  auto subscription_context = createSubscriptionContext();
+  subscribe(&SantaDecisionEventSubscriber::Callback, subscription_context);
+  return osquery::Status(0, "OK");
+}
+
+osquery::Status SantaDecisionEventSubscriber::Callback(
+    const SantaLogEventContextRef& event_context,
+    const SantaLogSubscriptionContextRef& subscription_context) {
+  const auto& entry = event_context->entry;
+
+  osquery::Row row;
+  row["decision"] = (event_context->type == kDenied) ? "DENY" : "ALLOW";
+  row["timestamp"] = entry.timestamp;
+  row["time"] = std::to_string(entry.time);
+
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    row[std::string(kLogFields[i].column)] = entry.fields[i];
+  }
+
+  return add(row);
+}
+
+osquery::TableColumns SantaDecisionEventsTablePlugin::columns() const {
+  // clang-format off
+  osquery::TableColumns columns = {
+      std::make_tuple("decision",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::DEFAULT)
+  };
+  // clang-format on
+
+  auto decision_columns = decisionEntryColumns();
+  columns.insert(
+      columns.end(), decision_columns.begin(), decision_columns.end());
+
+  columns.push_back(std::make_tuple(
+      "eid", osquery::TEXT_TYPE, osquery::ColumnOptions::HIDDEN));
+
+  return columns;
+}
+
+osquery::TableRows SantaDecisionEventsTablePlugin::generate(
+    osquery::QueryContext& request) {
+  if (!osquery::EventFactory::exists("santa_decision_events")) {
+    VLOG(1) << "The santa_decision_events subscriber is not running";
+    return {};
+  }
+
+  auto subscriber =
+      osquery::EventFactory::getEventSubscriber("santa_decision_events");
+  return subscriber->genTable(request);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <osquery/events/events.h>
+#include <osquery/sdk/sdk.h>
+
+#include "santalogpublisher.h"
+
+// Records every decision the publisher fires in osquery's event store, where
+// the framework expires them after --events_expiry seconds
+class SantaDecisionEventSubscriber final
+    : public osquery::EventSubscriber<SantaLogEventPublisher> {
+ public:
+  osquery::Status init() override;
+
+ private:
+  osquery::Status Callback(
+      const SantaLogEventContextRef& event_context,
+      const SantaLogSubscriptionContextRef& subscription_context);
+};
+
+// The decisions recorded by SantaDecisionEventSubscriber. Scheduled queries
+// only get the events added since their previous run.
+class SantaDecisionEventsTablePlugin final : public osquery::TablePlugin {
+ private:
+  osquery::TableColumns columns() const override;
+
+  osquery::TableRows generate(osquery::QueryContext& request) override;
+};
@@ -1,36 +1,162 @@
 
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <osquery/logger/logger.h>
 #include <osquery/sql/dynamic_table_row.h>
 
 #include "santa.h"
 #include "santadecisionstable.h"
 
-osquery::TableColumns decisionTablesColumns() {
+osquery::TableColumns decisionEntryColumns() {
   // clang-format off
-  return {
+  osquery::TableColumns columns = {
       std::make_tuple("timestamp",
                       osquery::TEXT_TYPE,
                       osquery::ColumnOptions::DEFAULT),
 
-      std::make_tuple("path",
-                      osquery::TEXT_TYPE,
-                      osquery::ColumnOptions::DEFAULT),
+      std::make_tuple("time",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::INDEX)
+  };
+  // clang-format on
 
-      std::make_tuple("shasum",
-                      osquery::TEXT_TYPE,
-                      osquery::ColumnOptions::DEFAULT),
+  for (const auto& field : kLogFields) {
+    auto type = (field.type == LogFieldDescriptor::Type::Integer)
+                    ? osquery::INTEGER_TYPE
+                    : osquery::TEXT_TYPE;
 
-      std::make_tuple("reason",
-                      osquery::TEXT_TYPE,
-                      osquery::ColumnOptions::DEFAULT)
-  };
+    auto options = field.indexed ? osquery::ColumnOptions::INDEX
+                                 : osquery::ColumnOptions::DEFAULT;
+
+    columns.push_back(std::make_tuple(std::string(field.column), type, options));
+  }
+
+  return columns;
+}
+
+osquery::TableColumns decisionTablesColumns() {
+  auto columns = decisionEntryColumns();
+
+  // clang-format off
+  columns.push_back(std::make_tuple("lookback_seconds",
+                                    osquery::BIGINT_TYPE,
+                                    osquery::ColumnOptions::HIDDEN));
+
+  columns.push_back(std::make_tuple("max_rows",
+                                    osquery::BIGINT_TYPE,
+                                    osquery::ColumnOptions::HIDDEN));
+
+  columns.push_back(std::make_tuple("truncated",
+                                    osquery::INTEGER_TYPE,
+                                    osquery::ColumnOptions::HIDDEN));
   // clang-format on
+
+  return columns;
+}
+
+// Narrows the filter's time bounds with the comparisons on the time column
+void getTimeConstraints(osquery::QueryContext& request, DecisionFilter& filter) {
+  auto& constraints = request.constraints["time"];
+
+  for (auto value : constraints.getAll<long long>(osquery::EQUALS)) {
+    filter.min_time = std::max<std::int64_t>(filter.min_time, value);
+    filter.max_time = std::min<std::int64_t>(filter.max_time, value);
+  }
+
+  for (auto value : constraints.getAll<long long>(osquery::GREATER_THAN)) {
+    if (value < std::numeric_limits<std::int64_t>::max()) {
+      filter.min_time = std::max<std::int64_t>(filter.min_time, value + 1);
+    }
+  }
+
+  for (auto value :
+       constraints.getAll<long long>(osquery::GREATER_THAN_OR_EQUALS)) {
+    filter.min_time = std::max<std::int64_t>(filter.min_time, value);
+  }
+
+  for (auto value : constraints.getAll<long long>(osquery::LESS_THAN)) {
+    if (value > std::numeric_limits<std::int64_t>::min()) {
+      filter.max_time = std::min<std::int64_t>(filter.max_time, value - 1);
+    }
+  }
+
+  for (auto value : constraints.getAll<long long>(osquery::LESS_THAN_OR_EQUALS)) {
+    filter.max_time = std::min<std::int64_t>(filter.max_time, value);
+  }
+}
+
+// Compiles the LIKE and GLOB constraints on the path column into a single
+// matcher, which skips non-matching lines before they are parsed
+void getPathPatterns(osquery::QueryContext& request, DecisionFilter& filter) {
+  auto& constraints = request.constraints["path"];
+
+  std::vector<PathPattern> patterns;
+  for (const auto& pattern : constraints.getAll(osquery::LIKE)) {
+    patterns.push_back({PathPattern::Syntax::Like, pattern});
+  }
+
+  for (const auto& pattern : constraints.getAll(osquery::GLOB)) {
+    patterns.push_back({PathPattern::Syntax::Glob, pattern});
+  }
+
+  if (!patterns.empty()) {
+    filter.path_matcher = std::make_shared<PathMatcher>(patterns);
+  }
 }
 
 osquery::TableRows decisionTablesGenerate(osquery::QueryContext& request,
-                                          SantaDecisionType decision) {
+                                          SantaEventType type) {
+  // Equality and IN constraints on shasum and path are answered through the
+  // decision store's indexes; SQLite still applies every other constraint
+  DecisionFilter filter;
+  filter.sha256s = request.constraints["shasum"].getAll(osquery::EQUALS);
+  filter.paths = request.constraints["path"].getAll(osquery::EQUALS);
+
+  // Time comparisons also let whole log files be skipped
+  getTimeConstraints(request, filter);
+  getPathPatterns(request, filter);
+
+  // A lookback or a row limit only wants the newest entries, which are read
+  // from the end of the live log. The value is echoed back in every row so
+  // that SQLite keeps them.
+  std::string lookback_seconds;
+  auto lookbacks =
+      request.constraints["lookback_seconds"].getAll<long long>(osquery::EQUALS);
+  if (!lookbacks.empty()) {
+    auto lookback = std::max<long long>(*lookbacks.begin(), 0);
+    lookback_seconds = std::to_string(*lookbacks.begin());
+    filter.min_time = std::max<std::int64_t>(
+        filter.min_time, static_cast<std::int64_t>(std::time(nullptr)) - lookback);
+    filter.read_backwards = true;
+  }
+
+  std::string max_rows;
+  auto row_limits =
+      request.constraints["max_rows"].getAll<long long>(osquery::EQUALS);
+  if (!row_limits.empty()) {
+    // a limit of 0 or less returns every row
+    max_rows = std::to_string(*row_limits.begin());
+    if (*row_limits.begin() > 0) {
+      filter.max_rows = static_cast<size_t>(*row_limits.begin());
+      filter.read_backwards = true;
+    }
+  }
+
+  // Only copy the fields the query reads
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    filter.fields[i] = request.isColumnUsed(std::string(kLogFields[i].column));
+  }
+
+  // Set when the log could not be scanned within the query's budget
+  bool truncated;
   LogEntries log_entries;
-  if (!scrapeSantaLog(log_entries, decision)) {
+  if (!scrapeSantaLog(log_entries, type, filter, truncated)) {
     return {};
   }
 
@@ -38,32 +164,25 @@ osquery::TableRows decisionTablesGenerate(osquery::QueryContext& request,
   for (const auto& entry : log_entries) {
     osquery::DynamicTableRowHolder row;
     row["timestamp"] = entry.timestamp;
-    row["path"] = entry.application;
-    row["shasum"] = entry.sha256;
-    row["reason"] = entry.reason;
+    row["time"] = std::to_string(entry.time);
+    row["truncated"] = truncated ? "1" : "0";
 
-    result.emplace_back(row);
-  }
+    if (!lookback_seconds.empty()) {
+      row["lookback_seconds"] = lookback_seconds;
+    }
 
-  return result;
-}
+    if (!max_rows.empty()) {
+      row["max_rows"] = max_rows;
+    }
 
-osquery::TableRows SantaAllowedDecisionsTablePlugin::generate(
-    osquery::QueryContext& request) {
-  auto rows = decisionTablesGenerate(request, decision);
-  return rows;
-}
-
-osquery::TableRows SantaDeniedDecisionsTablePlugin::generate(
-    osquery::QueryContext& request) {
-  auto rows = decisionTablesGenerate(request, decision);
-  return rows;
-}
+    for (size_t i = 0; i < kLogFieldCount; ++i) {
+      if (filter.fields.test(i)) {
+        row[std::string(kLogFields[i].column)] = entry.fields[i];
+      }
+    }
 
-osquery::TableColumns SantaAllowedDecisionsTablePlugin::columns() const {
-  return decisionTablesColumns();
-}
+    result.emplace_back(row);
+  }
 
-osquery::TableColumns SantaDeniedDecisionsTablePlugin::columns() const {
-  return decisionTablesColumns();
+  return result;
 }
@@ -3,18 +3,28 @@
 #include <osquery/sdk/sdk.h>
 #include "santa.h"
 
-class SantaAllowedDecisionsTablePlugin final : public osquery::TablePlugin {
- private:
-  static const SantaDecisionType decision = kAllowed;
-  osquery::TableColumns columns() const override;
+// The columns of a decision log entry
+osquery::TableColumns decisionEntryColumns();
 
-  osquery::TableRows generate(osquery::QueryContext& request) override;
-};
+// The entry columns, followed by the hidden ones that bound how far back a
+// query reads and tell whether it ran out of time
+osquery::TableColumns decisionTablesColumns();
+osquery::TableRows decisionTablesGenerate(osquery::QueryContext& request,
+                                          SantaEventType type);
 
-class SantaDeniedDecisionsTablePlugin final : public osquery::TablePlugin {
+// A table over one partition of the Santa log. A table for another event type
+// is one more alias, registered in main.cpp.
+template <SantaEventType event_type>
+class SantaEventsTablePlugin final : public osquery::TablePlugin {
  private:
-  static const SantaDecisionType decision = kDenied;
-  osquery::TableColumns columns() const override;
+  osquery::TableColumns columns() const override {
+    return decisionTablesColumns();
+  }
+
+  osquery::TableRows generate(osquery::QueryContext& request) override {
+    return decisionTablesGenerate(request, event_type);
+  }
+};
 
-  osquery::TableRows generate(osquery::QueryContext& request) override;
-};
\ No newline at end of file
+using SantaAllowedDecisionsTablePlugin = SantaEventsTablePlugin<kAllowed>;
+using SantaDeniedDecisionsTablePlugin = SantaEventsTablePlugin<kDenied>;
@@ -0,0 +1,205 @@
+#include "santalogpublisher.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <osquery/core/flags.h>
+#include <osquery/logger/logger.h>
+
+#include "logsource.h"
+
+DECLARE_string(santa_log_path);
+
+FLAG(uint64,
+     santa_log_watch_interval,
+     1000,
+     "Longest time in milliseconds between two checks of the Santa log for "
+     "new decision events");
+
+FLAG(bool,
+     santa_log_watch_polling,
+     false,
+     "Poll the Santa log for new decision events instead of relying on file "
+     "notifications");
+
+const size_t kLogReadSize = 65536;
+
+osquery::Status SantaLogEventPublisher::setUp() {
+  const auto& source = getLogSource();
+  watcher_ = createLogWatcher(source.getWatchedPath(),
+                              FLAGS_santa_log_watch_polling);
+
+  // Only what is written from now on becomes an event. A log that does not
+  // exist yet is read from its start once it appears.
+  if (source.hasLiveLog()) {
+    openLog(true);
+  } else {
+    readSpool(false);
+  }
+
+  return osquery::Status(0, "OK");
+}
+
+void SantaLogEventPublisher::tearDown() {
+  closeLog();
+  watcher_.reset();
+}
+
+osquery::Status SantaLogEventPublisher::run() {
+  auto interval = std::max<std::uint64_t>(FLAGS_santa_log_watch_interval, 10U);
+  watcher_->wait(std::chrono::milliseconds(interval));
+
+  if (!getLogSource().hasLiveLog()) {
+    readSpool(true);
+    return osquery::Status(0, "OK");
+  }
+
+  if (fd_ != -1) {
+    readLog();
+
+    struct stat path_stat;
+    if (stat(FLAGS_santa_log_path.c_str(), &path_stat) == 0 &&
+        path_stat.st_ino != inode_) {
+      // Santa may have written to the old file since it was read, until it
+      // reopened the log
+      VLOG(1) << "The Santa log was rotated, following the new file";
+      readLog();
+      closeLog();
+    }
+  }
+
+  if (fd_ == -1 && openLog(false)) {
+    readLog();
+  }
+
+  return osquery::Status(0, "OK");
+}
+
+bool SantaLogEventPublisher::openLog(bool at_end) {
+  fd_ = open(FLAGS_santa_log_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) {
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0) {
+    closeLog();
+    return false;
+  }
+
+  inode_ = file_stat.st_ino;
+  offset_ = at_end ? file_stat.st_size : 0;
+  partial_record_.clear();
+  return true;
+}
+
+void SantaLogEventPublisher::closeLog() {
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void SantaLogEventPublisher::readLog() {
+  struct stat file_stat;
+  if (fstat(fd_, &file_stat) != 0) {
+    return;
+  }
+
+  if (file_stat.st_size < offset_) {
+    VLOG(1) << "The Santa log was truncated, reading it from the start";
+    offset_ = 0;
+    partial_record_.clear();
+  }
+
+  std::vector<char> buffer(kLogReadSize);
+  while (offset_ < file_stat.st_size) {
+    auto count = pread(fd_, buffer.data(), buffer.size(), offset_);
+    if (count <= 0) {
+      break;
+    }
+
+    offset_ += count;
+    partial_record_.append(buffer.data(), static_cast<size_t>(count));
+
+    auto complete_size = getLogSource().getCompleteSize(partial_record_);
+    if (complete_size != 0) {
+      fireDecisions(std::string_view(partial_record_).substr(0, complete_size));
+      partial_record_.erase(0, complete_size);
+    }
+  }
+}
+
+void SantaLogEventPublisher::readSpool(bool fire) {
+  // Spool files are listed newest first, and fired oldest first
+  auto spool_files = getLogSource().listArchives();
+
+  std::set<std::string> listed_files;
+  for (auto file_it = spool_files.rbegin(); file_it != spool_files.rend();
+       ++file_it) {
+    listed_files.insert(*file_it);
+    if (!fire || spool_files_.count(*file_it) != 0) {
+      continue;
+    }
+
+    std::string contents;
+    if (readSpoolFile(*file_it, contents)) {
+      fireDecisions(contents);
+    }
+  }
+
+  // Files removed once they were uploaded are forgotten
+  spool_files_ = std::move(listed_files);
+}
+
+bool SantaLogEventPublisher::readSpoolFile(const std::string& path,
+                                           std::string& contents) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    VLOG(1) << "Failed to open the Santa spool file " << path;
+    return false;
+  }
+
+  contents.clear();
+  std::vector<char> buffer(kLogReadSize);
+  ssize_t count;
+  while ((count = read(fd, buffer.data(), buffer.size())) > 0) {
+    contents.append(buffer.data(), static_cast<size_t>(count));
+  }
+
+  close(fd);
+  if (count < 0) {
+    VLOG(1) << "Failed to read the Santa spool file " << path;
+    return false;
+  }
+
+  return true;
+}
+
+void SantaLogEventPublisher::fireDecisions(std::string_view records) {
+  static const auto decision_types =
+      SantaEventTypeSet().set(kAllowed).set(kDenied);
+
+  getLogSource().decode(
+      records,
+      decision_types,
+      nullptr,
+      [this](SantaEventType type, const LogEntryView& values) {
+        auto event_context = createEventContext();
+        event_context->type = type;
+        event_context->entry.timestamp = std::string(values.timestamp);
+        event_context->entry.time = values.time;
+        for (size_t i = 0; i < kLogFieldCount; ++i) {
+          event_context->entry.fields[i] = std::string(values.fields[i]);
+        }
+
+        fire(event_context);
+      });
+}
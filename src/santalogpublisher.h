@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include <osquery/events/events.h>
+
+#include "logwatcher.h"
+#include "santa.h"
+
+struct SantaLogSubscriptionContext final
+    : public osquery::SubscriptionContext {};
+
+// An execution decision appended to the Santa log
+struct SantaLogEventContext final : public osquery::EventContext {
+  SantaEventType type{kAllowed};
+  LogEntry entry;
+};
+
+using SantaLogSubscriptionContextRef =
+    std::shared_ptr<SantaLogSubscriptionContext>;
+using SantaLogEventContextRef = std::shared_ptr<SantaLogEventContext>;
+
+// Follows the live Santa log and fires an event for every ALLOW or DENY
+// decision written to it after the publisher started. When the log is
+// rotated, the rest of the old file is read before moving on to the new one.
+// Logs without a live file (the protobuf spool) have the decisions of every
+// new spool file fired instead.
+class SantaLogEventPublisher final
+    : public osquery::EventPublisher<SantaLogSubscriptionContext,
+                                     SantaLogEventContext> {
+  DECLARE_PUBLISHER("santa_log");
+
+ public:
+  osquery::Status setUp() override;
+
+  void tearDown() override;
+
+  osquery::Status run() override;
+
+ private:
+  // Opens whatever is at the log path, positioned at its end or its start
+  bool openLog(bool at_end);
+
+  void closeLog();
+
+  // Reads the open file up to its current end
+  void readLog();
+
+  // Looks for spool files that were not there before, and fires their
+  // decisions if asked to
+  void readSpool(bool fire);
+
+  static bool readSpoolFile(const std::string& path, std::string& contents);
+
+  // Fires the decisions found in a buffer of complete records
+  void fireDecisions(std::string_view records);
+
+  std::unique_ptr<LogWatcher> watcher_;
+
+  int fd_{-1};
+  ino_t inode_{0};
+  off_t offset_{0};
+
+  // Bytes after the last complete record read so far
+  std::string partial_record_;
+
+  // Spool files seen so far
+  std::set<std::string> spool_files_;
+};
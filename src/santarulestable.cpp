@@ -36,6 +36,11 @@ struct SantaRulesTablePlugin::PrivateData final {
 
   std::unordered_map<RowID, std::string> rowid_to_pkey;
   std::unordered_map<std::string, RuleEntry> rule_list;
+
+  // The state of the rule database the rules above were read from. They are
+  // only read again once it changes.
+  bool rules_valid{false};
+  RulesFingerprint rules_fingerprint;
 };
 
 osquery::Status SantaRulesTablePlugin::GetRowData(
@@ -159,26 +164,24 @@ osquery::TableColumns SantaRulesTablePlugin::columns() const {
 
 osquery::TableRows SantaRulesTablePlugin::generate(
     osquery::QueryContext& request) {
-  std::unordered_map<RowID, std::string> rowid_to_pkey;
-  std::unordered_map<std::string, RuleEntry> rule_list;
   osquery::TableRows result;
 
-  {
-    std::lock_guard<std::mutex> lock(d->mutex);
-
-    auto status = updateRules();
-    if (!status.ok()) {
-      VLOG(1) << status.getMessage();
-      osquery::DynamicTableRowHolder row;
-      row["status"] = "failure";
-      result.emplace_back(row);
-      return result;
-    }
+  // Rows are emitted straight from the cached rules, which only a change to
+  // the database causes to be read again
+  std::lock_guard<std::mutex> lock(d->mutex);
 
-    rowid_to_pkey = d->rowid_to_pkey;
-    rule_list = d->rule_list;
+  auto status = updateRules(false);
+  if (!status.ok()) {
+    VLOG(1) << status.getMessage();
+    osquery::DynamicTableRowHolder row;
+    row["status"] = "failure";
+    result.emplace_back(row);
+    return result;
   }
 
+  const auto& rowid_to_pkey = d->rowid_to_pkey;
+  const auto& rule_list = d->rule_list;
+
   for (const auto& rowid_pkey_pair : rowid_to_pkey) {
     const auto& rowid = rowid_pkey_pair.first;
     const auto& pkey = rowid_pkey_pair.second;
@@ -300,7 +303,7 @@ osquery::QueryData SantaRulesTablePlugin::insert(
   VLOG(1) << "santactl output: " << santactl_output.std_output;
 
   // Enumerate the rules and search for the one we just added
-  status = updateRules();
+  status = updateRules(true);
   if (!status.ok()) {
     VLOG(1) << "updateRules failed: " << status.getMessage();
     return {{std::make_pair("status", "failure"), 
@@ -363,6 +366,9 @@ osquery::QueryData SantaRulesTablePlugin::insert(
     auto synthetic_key = generatePrimaryKey(new_rule);
     d->rule_list.insert({synthetic_key, new_rule});
     d->rowid_to_pkey.insert({row_id, synthetic_key});
+
+    // It only stands in for the real rule until the next query
+    d->rules_valid = false;
     
     rule_found = true;
   }
@@ -486,7 +492,7 @@ osquery::QueryData SantaRulesTablePlugin::delete_(
     return {{std::make_pair("status", "failure")}};
   }
 
-  auto status = updateRules();
+  auto status = updateRules(true);
   if (!status.ok()) {
     VLOG(1) << status.getMessage();
     return {{std::make_pair("status", "failure")}};
@@ -504,7 +510,16 @@ osquery::QueryData SantaRulesTablePlugin::update(
   return {{std::make_pair("status", "failure")}};
 }
 
-osquery::Status SantaRulesTablePlugin::updateRules() {
+osquery::Status SantaRulesTablePlugin::updateRules(bool force) {
+  // The fingerprint is taken before reading, so that a change made while
+  // reading is picked up by the next query
+  auto fingerprint = getSantaRulesFingerprint();
+  if (!force && d->rules_valid && fingerprint == d->rules_fingerprint) {
+    return osquery::Status(0);
+  }
+
+  d->rules_valid = false;
+
   RuleEntries new_rule_list;
   if (!collectSantaRules(new_rule_list)) {
     return osquery::Status(1, "Failed to enumerate the Santa rules");
@@ -543,5 +558,7 @@ osquery::Status SantaRulesTablePlugin::updateRules() {
     d->rowid_to_pkey.insert({rowid, primary_key});
   }
 
+  d->rules_valid = true;
+  d->rules_fingerprint = fingerprint;
   return osquery::Status(0);
 }
\ No newline at end of file
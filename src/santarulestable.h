@@ -32,5 +32,7 @@ class SantaRulesTablePlugin final : public osquery::TablePlugin {
       osquery::QueryContext& context,
       const osquery::PluginRequest& request) override;
 
-  osquery::Status updateRules();
+  // Reads the rules again if the rule database changed since they were last
+  // read, or if forced to
+  osquery::Status updateRules(bool force);
 };
\ No newline at end of file
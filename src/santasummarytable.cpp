@@ -0,0 +1,87 @@
+#include "santasummarytable.h"
+
+#include <string>
+#include <vector>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include "santa.h"
+
+osquery::TableColumns SantaDecisionSummaryTablePlugin::columns() const {
+  // clang-format off
+  return {
+      std::make_tuple("decision",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("shasum",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::INDEX),
+
+      std::make_tuple("path",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::INDEX),
+
+      std::make_tuple("count",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("first_seen",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("last_seen",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("reason",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("truncated",
+                      osquery::INTEGER_TYPE,
+                      osquery::ColumnOptions::HIDDEN)
+  };
+  // clang-format on
+}
+
+osquery::TableRows SantaDecisionSummaryTablePlugin::generate(
+    osquery::QueryContext& request) {
+  DecisionFilter filter;
+  filter.sha256s = request.constraints["shasum"].getAll(osquery::EQUALS);
+  filter.paths = request.constraints["path"].getAll(osquery::EQUALS);
+
+  // Only summarize the decisions the query asks for
+  auto decisions = request.constraints["decision"].getAll(osquery::EQUALS);
+  std::vector<std::pair<SantaEventType, std::string>> types;
+  for (const auto& type : {std::make_pair(kAllowed, std::string("ALLOW")),
+                           std::make_pair(kDenied, std::string("DENY"))}) {
+    if (decisions.empty() || decisions.count(type.second) != 0) {
+      types.push_back(type);
+    }
+  }
+
+  osquery::TableRows result;
+  for (const auto& type : types) {
+    bool truncated;
+    DecisionSummaries summaries;
+    if (!summarizeSantaDecisions(summaries, type.first, filter, truncated)) {
+      continue;
+    }
+
+    for (const auto& summary : summaries) {
+      osquery::DynamicTableRowHolder row;
+      row["decision"] = type.second;
+      row["shasum"] = summary.second.sha256;
+      row["path"] = summary.second.path;
+      row["count"] = std::to_string(summary.second.count);
+      row["first_seen"] = std::to_string(summary.second.first_seen);
+      row["last_seen"] = std::to_string(summary.second.last_seen);
+      row["reason"] = summary.second.reason;
+      row["truncated"] = truncated ? "1" : "0";
+      result.emplace_back(row);
+    }
+  }
+
+  return result;
+}
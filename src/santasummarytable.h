@@ -0,0 +1,13 @@
+#pragma once
+
+#include <osquery/sdk/sdk.h>
+
+// Decision counts by sha256, path and decision. The summaries are kept with
+// the decision cache, so a query costs one row per distinct binary and path
+// rather than one per log line.
+class SantaDecisionSummaryTablePlugin final : public osquery::TablePlugin {
+ private:
+  osquery::TableColumns columns() const override;
+
+  osquery::TableRows generate(osquery::QueryContext& request) override;
+};
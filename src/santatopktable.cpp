@@ -0,0 +1,75 @@
+#include "santatopktable.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include <osquery/sql/dynamic_table_row.h>
+
+#include "santa.h"
+
+osquery::TableColumns SantaDeniedTopKTablePlugin::columns() const {
+  // clang-format off
+  return {
+      std::make_tuple("shasum",
+                      osquery::TEXT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("count",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("error_bound",
+                      osquery::BIGINT_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("confidence",
+                      osquery::DOUBLE_TYPE,
+                      osquery::ColumnOptions::DEFAULT),
+
+      std::make_tuple("days",
+                      osquery::INTEGER_TYPE,
+                      osquery::ColumnOptions::HIDDEN),
+
+      std::make_tuple("truncated",
+                      osquery::INTEGER_TYPE,
+                      osquery::ColumnOptions::HIDDEN)
+  };
+  // clang-format on
+}
+
+osquery::TableRows SantaDeniedTopKTablePlugin::generate(
+    osquery::QueryContext& request) {
+  // The window is echoed back in every row so that SQLite keeps them
+  std::uint64_t days = 0;
+  std::string days_value;
+  auto windows = request.constraints["days"].getAll<long long>(osquery::EQUALS);
+  if (!windows.empty()) {
+    days = static_cast<std::uint64_t>(std::max<long long>(*windows.begin(), 0));
+    days_value = std::to_string(*windows.begin());
+  }
+
+  bool truncated;
+  DeniedBinaries denied_binaries;
+  if (!getTopDeniedBinaries(denied_binaries, days, truncated)) {
+    return {};
+  }
+
+  osquery::TableRows result;
+  for (const auto& denied_binary : denied_binaries) {
+    osquery::DynamicTableRowHolder row;
+    row["shasum"] = denied_binary.sha256;
+    row["count"] = std::to_string(denied_binary.count);
+    row["error_bound"] = std::to_string(denied_binary.error_bound);
+    row["confidence"] = std::to_string(denied_binary.confidence);
+    row["truncated"] = truncated ? "1" : "0";
+
+    if (!days_value.empty()) {
+      row["days"] = days_value;
+    }
+
+    result.emplace_back(row);
+  }
+
+  return result;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <osquery/sdk/sdk.h>
+
+// The most denied binaries, estimated in fixed memory from every denial the
+// extension has read, along with the bounds of the estimates
+class SantaDeniedTopKTablePlugin final : public osquery::TablePlugin {
+ private:
+  osquery::TableColumns columns() const override;
+
+  osquery::TableRows generate(osquery::QueryContext& request) override;
+};
@@ -0,0 +1,70 @@
+#include "scanbudget.h"
+
+#include <time.h>
+
+#include <thread>
+
+namespace {
+
+const std::chrono::seconds kThrottleWindow(1);
+
+} // namespace
+
+std::chrono::nanoseconds getProcessCpuTime() {
+  struct timespec cpu_time;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time) != 0) {
+    return std::chrono::nanoseconds(0);
+  }
+
+  return std::chrono::seconds(cpu_time.tv_sec) +
+         std::chrono::nanoseconds(cpu_time.tv_nsec);
+}
+
+ScanBudget::ScanBudget(std::chrono::milliseconds time_limit,
+                       std::chrono::milliseconds cpu_limit)
+    : start_time_(std::chrono::steady_clock::now()),
+      start_cpu_time_(getProcessCpuTime()),
+      time_limit_(time_limit),
+      cpu_limit_(cpu_limit) {}
+
+bool ScanBudget::exhausted() const {
+  if (time_limit_.count() != 0 &&
+      std::chrono::steady_clock::now() - start_time_ >= time_limit_) {
+    return true;
+  }
+
+  return cpu_limit_.count() != 0 &&
+         getProcessCpuTime() - start_cpu_time_ >= cpu_limit_;
+}
+
+void ScanThrottle::pace(std::uint64_t cpu_percent) {
+  if (cpu_percent == 0) {
+    return;
+  }
+
+  std::chrono::nanoseconds delay(0);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    auto cpu_time = getProcessCpuTime();
+    if (now - window_start_time_ >= kThrottleWindow) {
+      window_start_time_ = now;
+      window_start_cpu_time_ = cpu_time;
+      return;
+    }
+
+    // The wall clock time the CPU time used so far should have taken
+    auto paced_time =
+        (cpu_time - window_start_cpu_time_) * 100 / cpu_percent;
+    auto elapsed_time = now - window_start_time_;
+    if (paced_time > elapsed_time) {
+      delay = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          paced_time - elapsed_time);
+    }
+  }
+
+  if (delay.count() > 0) {
+    std::this_thread::sleep_for(delay);
+  }
+}
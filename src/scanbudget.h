@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// CPU time used by all the threads of the process so far
+std::chrono::nanoseconds getProcessCpuTime();
+
+// The wall clock and CPU time a query may spend before it returns what it has.
+// CPU time is counted for the whole process, background scans included, as
+// that is what the osquery watchdog looks at. A limit of zero is no limit.
+class ScanBudget final {
+ public:
+  ScanBudget(std::chrono::milliseconds time_limit,
+             std::chrono::milliseconds cpu_limit);
+
+  bool exhausted() const;
+
+ private:
+  std::chrono::steady_clock::time_point start_time_;
+  std::chrono::nanoseconds start_cpu_time_;
+  std::chrono::milliseconds time_limit_;
+  std::chrono::milliseconds cpu_limit_;
+};
+
+// Keeps scans under a share of one CPU. Scan loops call pace() between units
+// of work; it sleeps for as long as the CPU time used since the start of the
+// current one second window is ahead of that share of the time elapsed. Safe
+// to call from any number of threads.
+class ScanThrottle final {
+ public:
+  // cpu_percent of zero lets scans run at full speed
+  void pace(std::uint64_t cpu_percent);
+
+ private:
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point window_start_time_;
+  std::chrono::nanoseconds window_start_cpu_time_{0};
+};
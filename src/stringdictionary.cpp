@@ -0,0 +1,77 @@
+#include "stringdictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const size_t kDictionaryBlockSize = 65536;
+} // namespace
+
+std::uint32_t StringDictionary::intern(std::string_view value) {
+  auto id_it = ids_.find(value);
+  if (id_it != ids_.end()) {
+    return id_it->second;
+  }
+
+  auto id = static_cast<std::uint32_t>(values_.size());
+  auto stored = copyToBlock(value);
+  values_.push_back(stored);
+  ids_.emplace(stored, id);
+  return id;
+}
+
+std::uint32_t StringDictionary::internInPlace(std::string_view value) {
+  auto id_it = ids_.find(value);
+  if (id_it != ids_.end()) {
+    return id_it->second;
+  }
+
+  auto id = static_cast<std::uint32_t>(values_.size());
+  values_.push_back(value);
+  ids_.emplace(value, id);
+  in_place_size_ += value.size();
+  return id;
+}
+
+bool StringDictionary::find(std::string_view value, std::uint32_t& id) const {
+  auto id_it = ids_.find(value);
+  if (id_it == ids_.end()) {
+    return false;
+  }
+
+  id = id_it->second;
+  return true;
+}
+
+size_t StringDictionary::size() const {
+  return values_.size();
+}
+
+size_t StringDictionary::memoryUsage() const {
+  // Each hash table node holds a key, a value and a next pointer
+  return sizeof(*this) + allocated_size_ + in_place_size_ +
+         blocks_.capacity() * sizeof(blocks_[0]) +
+         values_.capacity() * sizeof(values_[0]) +
+         ids_.size() * (sizeof(*ids_.begin()) + sizeof(void*)) +
+         ids_.bucket_count() * sizeof(void*);
+}
+
+std::string_view StringDictionary::copyToBlock(std::string_view value) {
+  if (value.empty()) {
+    return {};
+  }
+
+  // Values larger than a block get a block of their own
+  if (block_size_ - block_used_ < value.size()) {
+    block_size_ = std::max(kDictionaryBlockSize, value.size());
+    blocks_.emplace_back(new char[block_size_]);
+    block_used_ = 0;
+    allocated_size_ += block_size_;
+  }
+
+  char* destination = blocks_.back().get() + block_used_;
+  std::memcpy(destination, value.data(), value.size());
+  block_used_ += value.size();
+
+  return std::string_view(destination, value.size());
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interns strings, handing out a dense id for each distinct value. Values are
+// copied once into large blocks that never move, so the views handed out stay
+// valid for as long as the dictionary lives, moves included. Values that
+// outlive the dictionary anyway can be interned in place instead.
+class StringDictionary final {
+ public:
+  std::uint32_t intern(std::string_view value);
+
+  // Interns a value without copying it. It must outlive the dictionary.
+  std::uint32_t internInPlace(std::string_view value);
+
+  // Looks up the id of a value without interning it
+  bool find(std::string_view value, std::uint32_t& id) const;
+
+  std::string_view get(std::uint32_t id) const {
+    return values_[id];
+  }
+
+  size_t size() const;
+
+  // Approximate heap and object size of the dictionary, values interned in
+  // place included
+  size_t memoryUsage() const;
+
+ private:
+  std::string_view copyToBlock(std::string_view value);
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t block_used_{0};
+  size_t block_size_{0};
+  size_t allocated_size_{0};
+  size_t in_place_size_{0};
+
+  std::vector<std::string_view> values_;
+  std::unordered_map<std::string_view, std::uint32_t> ids_;
+};
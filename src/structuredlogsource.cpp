@@ -0,0 +1,1002 @@
+#include "logsource.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
+
+#include <osquery/core/flags.h>
+
+#include <rapidjson/document.h>
+
+#include "logscanner.h"
+
+FLAG(string,
+     santa_spool_path,
+     "/var/db/santa/spool",
+     "Directory Santa spools its protobuf event log to, read when "
+     "--santa_log_format is protobuf");
+
+namespace {
+
+// Santa's structured log is santa.proto (santa.pb.v1) written either as
+// protobuf spool files or as JSON lines. Only executions are decoded, as
+// decisions are all the tables report.
+//
+// Field numbers of the messages on the way to the decision fields:
+//   LogBatch      records=1 (google.protobuf.Any: type_url=1 value=2)
+//   SantaMessage  event_time=2 processed_time=3 execution=10
+//   Execution     target=2 args=5 decision=9 reason=10 mode=11
+//                 certificate_info=12 explain=13
+//   ProcessInfo   id=1 parent_id=2 original_parent_pid=4 effective_user=7
+//                 effective_group=9 code_signature=13 executable=15
+const std::uint32_t kLogBatchRecords = 1;
+const std::uint32_t kAnyTypeUrl = 1;
+const std::uint32_t kAnyValue = 2;
+const std::uint32_t kMessageEventTime = 2;
+const std::uint32_t kMessageProcessedTime = 3;
+const std::uint32_t kMessageExecution = 10;
+const std::uint32_t kTimestampSeconds = 1;
+const std::uint32_t kTimestampNanos = 2;
+const std::uint32_t kExecutionTarget = 2;
+const std::uint32_t kExecutionArgs = 5;
+const std::uint32_t kExecutionDecision = 9;
+const std::uint32_t kExecutionReason = 10;
+const std::uint32_t kExecutionMode = 11;
+const std::uint32_t kExecutionCertificateInfo = 12;
+const std::uint32_t kExecutionExplain = 13;
+const std::uint32_t kCertificateHash = 1;
+const std::uint32_t kCertificateCommonName = 2;
+const std::uint32_t kProcessId = 1;
+const std::uint32_t kProcessParentId = 2;
+const std::uint32_t kProcessOriginalParentPid = 4;
+const std::uint32_t kProcessEffectiveUser = 7;
+const std::uint32_t kProcessEffectiveGroup = 9;
+const std::uint32_t kProcessCodeSignature = 13;
+const std::uint32_t kProcessExecutable = 15;
+const std::uint32_t kProcessIdPid = 1;
+const std::uint32_t kUserOrGroupId = 1;
+const std::uint32_t kUserOrGroupName = 2;
+const std::uint32_t kCodeSignatureCdhash = 1;
+const std::uint32_t kCodeSignatureSigningId = 2;
+const std::uint32_t kCodeSignatureTeamId = 3;
+const std::uint32_t kFileInfoPath = 1;
+const std::uint32_t kFileInfoHash = 4;
+const std::uint32_t kHashValue = 2;
+
+constexpr std::string_view kSantaMessageType = "santa.pb.v1.SantaMessage";
+
+// How santa.proto names an enum value, and how the text log writes it
+struct EnumName final {
+  std::string_view proto_name;
+  std::string_view log_name;
+};
+
+// Indexed by enum value
+// clang-format off
+constexpr std::array<EnumName, 4> kDecisionNames = {{
+  {"DECISION_UNKNOWN",        ""},
+  {"DECISION_ALLOW",          "ALLOW"},
+  {"DECISION_DENY",           "DENY"},
+  {"DECISION_ALLOW_COMPILER", "ALLOW_COMPILER"},
+}};
+
+constexpr std::array<EnumName, 12> kReasonNames = {{
+  {"REASON_UNKNOWN",            "UNKNOWN"},
+  {"REASON_BINARY",             "BINARY"},
+  {"REASON_CERT",               "CERT"},
+  {"REASON_COMPILER",           "COMPILER"},
+  {"REASON_PENDING_TRANSITIVE", "PENDING_TRANSITIVE"},
+  {"REASON_SCOPE",              "SCOPE"},
+  {"REASON_TEAM_ID",            "TEAMID"},
+  {"REASON_TRANSITIVE",         "TRANSITIVE"},
+  {"REASON_LONG_PATH",          "LONG_PATH"},
+  {"REASON_NOT_RUNNING",        "NOT_RUNNING"},
+  {"REASON_SIGNING_ID",         "SIGNINGID"},
+  {"REASON_CDHASH",             "CDHASH"},
+}};
+
+constexpr std::array<EnumName, 3> kModeNames = {{
+  {"MODE_UNKNOWN",  "U"},
+  {"MODE_LOCKDOWN", "L"},
+  {"MODE_MONITOR",  "M"},
+}};
+// clang-format on
+
+const std::uint64_t kDecisionDeny = 2;
+
+constexpr size_t kLogFieldExplain = getLogFieldIndex("explain");
+constexpr size_t kLogFieldCertSha256 = getLogFieldIndex("cert_sha256");
+constexpr size_t kLogFieldCertCommonName = getLogFieldIndex("cert_cn");
+constexpr size_t kLogFieldTeamId = getLogFieldIndex("teamid");
+constexpr size_t kLogFieldSigningId = getLogFieldIndex("signingid");
+constexpr size_t kLogFieldCdhash = getLogFieldIndex("cdhash");
+constexpr size_t kLogFieldPid = getLogFieldIndex("pid");
+constexpr size_t kLogFieldPpid = getLogFieldIndex("ppid");
+constexpr size_t kLogFieldUid = getLogFieldIndex("uid");
+constexpr size_t kLogFieldUser = getLogFieldIndex("user");
+constexpr size_t kLogFieldGid = getLogFieldIndex("gid");
+constexpr size_t kLogFieldGroup = getLogFieldIndex("group");
+constexpr size_t kLogFieldMode = getLogFieldIndex("mode");
+constexpr size_t kLogFieldArgs = getLogFieldIndex("args");
+
+const char kHexDigits[] = "0123456789abcdef";
+
+// An execution decoded from either encoding, with the same field values as
+// the text log. Text fields point into the record; values that have to be
+// formatted are kept in the entry. The entry must not be moved while its
+// view is in use.
+struct ExecutionEntry final {
+  LogEntryView view;
+  std::uint64_t decision{0};
+
+  std::string timestamp;
+  std::array<std::string, kLogFieldCount> formatted;
+
+  // A time from event_time, unless processed_time came first
+  bool has_processed_time{false};
+
+  void reset() {
+    view = {};
+    decision = 0;
+    has_processed_time = false;
+  }
+
+  void setNumber(size_t field, std::int64_t value) {
+    formatted[field] = std::to_string(value);
+    view.fields[field] = formatted[field];
+  }
+
+  void setHex(size_t field, std::string_view bytes) {
+    auto& text = formatted[field];
+    text.clear();
+    for (auto byte : bytes) {
+      text.push_back(kHexDigits[static_cast<unsigned char>(byte) >> 4]);
+      text.push_back(kHexDigits[static_cast<unsigned char>(byte) & 0xF]);
+    }
+
+    view.fields[field] = text;
+  }
+
+  void setTime(std::int64_t seconds, std::int64_t nanos, bool processed) {
+    if (has_processed_time && !processed) {
+      return;
+    }
+
+    has_processed_time = processed;
+    auto millis = static_cast<std::uint16_t>(
+        std::min<std::int64_t>(std::max<std::int64_t>(nanos, 0) / 1000000, 999));
+    if (formatLogTimestamp(seconds, millis, timestamp)) {
+      view.timestamp = timestamp;
+      view.time = seconds;
+    }
+  }
+};
+
+template <size_t N>
+std::string_view getLogName(const std::array<EnumName, N>& names,
+                            std::uint64_t value) {
+  return (value < N) ? names[value].log_name : names[0].log_name;
+}
+
+bool matchesPath(const ExecutionEntry& entry, const PathMatcher* path_matcher) {
+  return path_matcher == nullptr ||
+         path_matcher->matches(entry.view.fields[kLogFieldPath]);
+}
+
+// Hands a decoded execution to the callback, if it is wanted
+void emitExecution(const ExecutionEntry& entry,
+                   const SantaEventTypeSet& types,
+                   const PathMatcher* path_matcher,
+                   const LogEventCallback& callback) {
+  if (entry.decision == 0 || entry.decision >= kDecisionNames.size()) {
+    return;
+  }
+
+  auto type = (entry.decision == kDecisionDeny) ? kDenied : kAllowed;
+  if (types.test(type) && matchesPath(entry, path_matcher)) {
+    callback(type, entry.view);
+  }
+}
+
+//
+// Protobuf
+//
+
+// Reads a varint at pos. Fails when data ends first, or after the ten bytes
+// a varint can take.
+bool readVarint(std::string_view data, size_t& pos, std::uint64_t& value) {
+  value = 0;
+  for (unsigned int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+    auto byte = static_cast<unsigned char>(data[pos++]);
+    value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Walks the fields of a message in the protobuf wire format
+class WireReader final {
+ public:
+  explicit WireReader(std::string_view data) : data_(data) {}
+
+  // Moves to the next field. Returns false at the end of the message, or
+  // where it is malformed.
+  bool next() {
+    if (pos_ >= data_.size()) {
+      return false;
+    }
+
+    std::uint64_t key;
+    if (!readVarint(data_, pos_, key)) {
+      return fail();
+    }
+
+    field_ = static_cast<std::uint32_t>(key >> 3);
+    varint_ = 0;
+    bytes_ = {};
+
+    switch (key & 7) {
+    case 0:
+      return readVarint(data_, pos_, varint_) || fail();
+
+    case 1:
+      return skip(8);
+
+    case 2: {
+      std::uint64_t length;
+      if (!readVarint(data_, pos_, length) || length > data_.size() - pos_) {
+        return fail();
+      }
+
+      bytes_ = data_.substr(pos_, static_cast<size_t>(length));
+      pos_ += static_cast<size_t>(length);
+      return true;
+    }
+
+    case 5:
+      return skip(4);
+
+    default:
+      // groups are long deprecated, and santa.proto has none
+      return fail();
+    }
+  }
+
+  std::uint32_t field() const {
+    return field_;
+  }
+
+  // The value of a varint field
+  std::uint64_t varint() const {
+    return varint_;
+  }
+
+  // The value of a length delimited field
+  std::string_view bytes() const {
+    return bytes_;
+  }
+
+ private:
+  bool skip(size_t size) {
+    if (data_.size() - pos_ < size) {
+      return fail();
+    }
+
+    pos_ += size;
+    return true;
+  }
+
+  bool fail() {
+    pos_ = data_.size();
+    return false;
+  }
+
+  std::string_view data_;
+  size_t pos_{0};
+
+  std::uint32_t field_{0};
+  std::uint64_t varint_{0};
+  std::string_view bytes_;
+};
+
+// Reads a single field of a nested message, such as the pid of a ProcessID
+template <typename Callback>
+void forEachField(std::string_view message, Callback&& callback) {
+  WireReader reader(message);
+  while (reader.next()) {
+    callback(reader);
+  }
+}
+
+void decodeTimestamp(std::string_view message,
+                     bool processed,
+                     ExecutionEntry& entry) {
+  std::int64_t seconds = 0;
+  std::int64_t nanos = 0;
+  forEachField(message, [&](const WireReader& field) {
+    if (field.field() == kTimestampSeconds) {
+      seconds = static_cast<std::int64_t>(field.varint());
+    } else if (field.field() == kTimestampNanos) {
+      nanos = static_cast<std::int32_t>(field.varint());
+    }
+  });
+
+  entry.setTime(seconds, nanos, processed);
+}
+
+// A UserInfo or GroupInfo. Zero values are left out of messages, and the
+// text log prints them.
+void decodeIdentity(std::string_view message,
+                    size_t id_field,
+                    size_t name_field,
+                    ExecutionEntry& entry) {
+  entry.setNumber(id_field, 0);
+  forEachField(message, [&](const WireReader& field) {
+    if (field.field() == kUserOrGroupId) {
+      entry.setNumber(id_field, static_cast<std::int32_t>(field.varint()));
+    } else if (field.field() == kUserOrGroupName) {
+      entry.view.fields[name_field] = field.bytes();
+    }
+  });
+}
+
+// The pid of a ProcessID
+void decodeProcessId(std::string_view message,
+                     size_t pid_field,
+                     ExecutionEntry& entry) {
+  entry.setNumber(pid_field, 0);
+  forEachField(message, [&](const WireReader& field) {
+    if (field.field() == kProcessIdPid) {
+      entry.setNumber(pid_field, static_cast<std::int32_t>(field.varint()));
+    }
+  });
+}
+
+// The hash of a Hash
+std::string_view decodeHash(std::string_view message) {
+  std::string_view hash;
+  forEachField(message, [&](const WireReader& field) {
+    if (field.field() == kHashValue) {
+      hash = field.bytes();
+    }
+  });
+
+  return hash;
+}
+
+void decodeProcess(std::string_view message, ExecutionEntry& entry) {
+  bool has_original_parent = false;
+  forEachField(message, [&](const WireReader& field) {
+    switch (field.field()) {
+    case kProcessId:
+      decodeProcessId(field.bytes(), kLogFieldPid, entry);
+      break;
+
+    case kProcessParentId:
+      if (!has_original_parent) {
+        decodeProcessId(field.bytes(), kLogFieldPpid, entry);
+      }
+
+      break;
+
+    case kProcessOriginalParentPid:
+      // the text log reports the parent the process was started by
+      has_original_parent = true;
+      entry.setNumber(kLogFieldPpid, static_cast<std::int32_t>(field.varint()));
+      break;
+
+    case kProcessEffectiveUser:
+      decodeIdentity(field.bytes(), kLogFieldUid, kLogFieldUser, entry);
+      break;
+
+    case kProcessEffectiveGroup:
+      decodeIdentity(field.bytes(), kLogFieldGid, kLogFieldGroup, entry);
+      break;
+
+    case kProcessCodeSignature:
+      forEachField(field.bytes(), [&](const WireReader& signature) {
+        if (signature.field() == kCodeSignatureCdhash) {
+          entry.setHex(kLogFieldCdhash, signature.bytes());
+        } else if (signature.field() == kCodeSignatureSigningId) {
+          entry.view.fields[kLogFieldSigningId] = signature.bytes();
+        } else if (signature.field() == kCodeSignatureTeamId) {
+          entry.view.fields[kLogFieldTeamId] = signature.bytes();
+        }
+      });
+
+      break;
+
+    case kProcessExecutable:
+      forEachField(field.bytes(), [&](const WireReader& file) {
+        if (file.field() == kFileInfoPath) {
+          entry.view.fields[kLogFieldPath] = file.bytes();
+        } else if (file.field() == kFileInfoHash) {
+          entry.view.fields[kLogFieldSha256] = decodeHash(file.bytes());
+        }
+      });
+
+      break;
+    }
+  });
+}
+
+void decodeExecution(std::string_view message, ExecutionEntry& entry) {
+  auto& args = entry.formatted[kLogFieldArgs];
+  args.clear();
+
+  forEachField(message, [&](const WireReader& field) {
+    switch (field.field()) {
+    case kExecutionTarget:
+      decodeProcess(field.bytes(), entry);
+      break;
+
+    case kExecutionArgs:
+      if (!args.empty()) {
+        args.push_back(' ');
+      }
+
+      args.append(field.bytes());
+      entry.view.fields[kLogFieldArgs] = args;
+      break;
+
+    case kExecutionDecision:
+      entry.decision = field.varint();
+      break;
+
+    case kExecutionReason:
+      entry.view.fields[kLogFieldReason] =
+          getLogName(kReasonNames, field.varint());
+      break;
+
+    case kExecutionMode:
+      entry.view.fields[kLogFieldMode] = getLogName(kModeNames, field.varint());
+      break;
+
+    case kExecutionCertificateInfo:
+      forEachField(field.bytes(), [&](const WireReader& certificate) {
+        if (certificate.field() == kCertificateHash) {
+          entry.view.fields[kLogFieldCertSha256] =
+              decodeHash(certificate.bytes());
+        } else if (certificate.field() == kCertificateCommonName) {
+          entry.view.fields[kLogFieldCertCommonName] = certificate.bytes();
+        }
+      });
+
+      break;
+
+    case kExecutionExplain:
+      entry.view.fields[kLogFieldExplain] = field.bytes();
+      break;
+    }
+  });
+}
+
+// Decodes a SantaMessage. Returns false when it does not hold an execution;
+// its time is decoded either way.
+bool decodeSantaMessage(std::string_view message, ExecutionEntry& entry) {
+  std::string_view execution;
+  bool has_execution = false;
+  forEachField(message, [&](const WireReader& field) {
+    if (field.field() == kMessageEventTime) {
+      decodeTimestamp(field.bytes(), false, entry);
+    } else if (field.field() == kMessageProcessedTime) {
+      decodeTimestamp(field.bytes(), true, entry);
+    } else if (field.field() == kMessageExecution) {
+      execution = field.bytes();
+      has_execution = true;
+    }
+  });
+
+  if (has_execution) {
+    decodeExecution(execution, entry);
+  }
+
+  return has_execution;
+}
+
+// Calls callback(message) for every SantaMessage of a LogBatch. Batches
+// concatenated one after another read as a single one.
+template <typename Callback>
+void forEachSantaMessage(std::string_view batch, Callback&& callback) {
+  forEachField(batch, [&](const WireReader& record) {
+    if (record.field() != kLogBatchRecords) {
+      return;
+    }
+
+    std::string_view type_url;
+    std::string_view value;
+    forEachField(record.bytes(), [&](const WireReader& any) {
+      if (any.field() == kAnyTypeUrl) {
+        type_url = any.bytes();
+      } else if (any.field() == kAnyValue) {
+        value = any.bytes();
+      }
+    });
+
+    // type.googleapis.com/santa.pb.v1.SantaMessage
+    if (type_url.size() >= kSantaMessageType.size() &&
+        type_url.substr(type_url.size() - kSantaMessageType.size()) ==
+            kSantaMessageType) {
+      callback(value);
+    }
+  });
+}
+
+// Spool files in --santa_spool_path/new, each a serialized LogBatch that is
+// complete once it shows up there. There is no live log: every spool file is
+// read and cached like an archive.
+class ProtobufLogSource final : public LogSource {
+ public:
+  bool hasLiveLog() const override {
+    return false;
+  }
+
+  std::string getWatchedPath() const override {
+    return getSpoolDirectory() + "/";
+  }
+
+  std::vector<std::string> listArchives() const override {
+    auto directory_path = getSpoolDirectory();
+    auto directory = opendir(directory_path.c_str());
+    if (directory == nullptr) {
+      return {};
+    }
+
+    std::vector<std::pair<std::pair<time_t, std::string>, std::string>> files;
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != nullptr) {
+      auto path = directory_path + "/" + entry->d_name;
+
+      struct stat file_stat;
+      if (entry->d_name[0] != '.' && stat(path.c_str(), &file_stat) == 0 &&
+          S_ISREG(file_stat.st_mode)) {
+        files.push_back({{file_stat.st_mtime, entry->d_name}, path});
+      }
+    }
+
+    closedir(directory);
+
+    // newest first, by name within the same second
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+      return a.first > b.first;
+    });
+
+    std::vector<std::string> archives;
+    for (auto& file : files) {
+      archives.push_back(std::move(file.second));
+    }
+
+    return archives;
+  }
+
+  bool archivesCompressed() const override {
+    return false;
+  }
+
+  size_t getRecordSize(std::string_view data) const override {
+    // the largest a record header can be: a key, then a length
+    const size_t kMaxVarintSize = 10;
+
+    size_t pos = 0;
+    std::uint64_t key;
+    if (!readVarint(data, pos, key)) {
+      return (pos >= kMaxVarintSize) ? data.size() : 0;
+    }
+
+    std::uint64_t size = 0;
+    switch (key & 7) {
+    case 0: {
+      auto start = pos;
+      if (!readVarint(data, pos, size)) {
+        return (pos - start >= kMaxVarintSize) ? data.size() : 0;
+      }
+
+      return pos;
+    }
+
+    case 1:
+      size = 8;
+      break;
+
+    case 2: {
+      auto start = pos;
+      if (!readVarint(data, pos, size)) {
+        return (pos - start >= kMaxVarintSize) ? data.size() : 0;
+      }
+
+      break;
+    }
+
+    case 5:
+      size = 4;
+      break;
+
+    default:
+      return data.size();
+    }
+
+    return (size <= data.size() - pos) ? pos + static_cast<size_t>(size) : 0;
+  }
+
+  void decode(std::string_view data,
+              const SantaEventTypeSet& types,
+              const PathMatcher* path_matcher,
+              const LogEventCallback& callback) const override {
+    if (!types.test(kAllowed) && !types.test(kDenied)) {
+      return;
+    }
+
+    ExecutionEntry entry;
+    forEachSantaMessage(data, [&](std::string_view message) {
+      entry.reset();
+      if (decodeSantaMessage(message, entry)) {
+        emitExecution(entry, types, path_matcher, callback);
+      }
+    });
+  }
+
+  std::int64_t getFirstRecordTime(std::string_view data) const override {
+    ExecutionEntry entry;
+    auto size = getRecordSize(data);
+    forEachSantaMessage(data.substr(0, size), [&](std::string_view message) {
+      decodeSantaMessage(message, entry);
+    });
+
+    return entry.view.time;
+  }
+
+ private:
+  static std::string getSpoolDirectory() {
+    return FLAGS_santa_spool_path + "/new";
+  }
+};
+
+//
+// JSON
+//
+
+// santa.proto field names, as Santa prints them, and in the lowerCamelCase
+// protobuf's JSON printer uses by default
+struct JsonName final {
+  const char* name;
+  const char* camel_case_name;
+};
+
+const JsonName kJsonEventTime = {"event_time", "eventTime"};
+const JsonName kJsonProcessedTime = {"processed_time", "processedTime"};
+const JsonName kJsonExecution = {"execution", "execution"};
+const JsonName kJsonTarget = {"target", "target"};
+const JsonName kJsonArgs = {"args", "args"};
+const JsonName kJsonDecision = {"decision", "decision"};
+const JsonName kJsonReason = {"reason", "reason"};
+const JsonName kJsonMode = {"mode", "mode"};
+const JsonName kJsonCertificateInfo = {"certificate_info", "certificateInfo"};
+const JsonName kJsonCommonName = {"common_name", "commonName"};
+const JsonName kJsonExplain = {"explain", "explain"};
+const JsonName kJsonId = {"id", "id"};
+const JsonName kJsonParentId = {"parent_id", "parentId"};
+const JsonName kJsonOriginalParentPid = {"original_parent_pid",
+                                         "originalParentPid"};
+const JsonName kJsonPid = {"pid", "pid"};
+const JsonName kJsonEffectiveUser = {"effective_user", "effectiveUser"};
+const JsonName kJsonEffectiveGroup = {"effective_group", "effectiveGroup"};
+const JsonName kJsonUid = {"uid", "uid"};
+const JsonName kJsonGid = {"gid", "gid"};
+const JsonName kJsonName = {"name", "name"};
+const JsonName kJsonCodeSignature = {"code_signature", "codeSignature"};
+const JsonName kJsonCdhash = {"cdhash", "cdhash"};
+const JsonName kJsonSigningId = {"signing_id", "signingId"};
+const JsonName kJsonTeamId = {"team_id", "teamId"};
+const JsonName kJsonExecutable = {"executable", "executable"};
+const JsonName kJsonPath = {"path", "path"};
+const JsonName kJsonHash = {"hash", "hash"};
+
+// Every execution line holds this key
+constexpr std::string_view kJsonExecutionMarker = "\"execution\"";
+
+const rapidjson::Value* getMember(const rapidjson::Value* object,
+                                  const JsonName& name) {
+  if (object == nullptr || !object->IsObject()) {
+    return nullptr;
+  }
+
+  auto member = object->FindMember(name.name);
+  if (member == object->MemberEnd()) {
+    member = object->FindMember(name.camel_case_name);
+    if (member == object->MemberEnd()) {
+      return nullptr;
+    }
+  }
+
+  return &member->value;
+}
+
+std::string_view getString(const rapidjson::Value* value) {
+  if (value == nullptr || !value->IsString()) {
+    return {};
+  }
+
+  return std::string_view(value->GetString(), value->GetStringLength());
+}
+
+// Sets a numeric field of message, 0 if the message leaves it out. 64 bit
+// integers are printed as strings.
+void setJsonNumber(const rapidjson::Value* message,
+                   const rapidjson::Value* value,
+                   size_t field,
+                   ExecutionEntry& entry) {
+  if (message == nullptr) {
+    return;
+  }
+
+  if (value == nullptr) {
+    entry.setNumber(field, 0);
+  } else if (value->IsInt64()) {
+    entry.setNumber(field, value->GetInt64());
+  } else if (value->IsString()) {
+    entry.view.fields[field] = getString(value);
+  }
+}
+
+// Enums are printed by name, or by number when asked to
+template <size_t N>
+std::uint64_t getJsonEnum(const rapidjson::Value* value,
+                          const std::array<EnumName, N>& names) {
+  if (value != nullptr && value->IsUint64()) {
+    return value->GetUint64();
+  }
+
+  auto name = getString(value);
+  for (size_t i = 0; i < N; ++i) {
+    if (names[i].proto_name == name) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+int getBase64Value(char digit) {
+  if (digit >= 'A' && digit <= 'Z') {
+    return digit - 'A';
+  }
+
+  if (digit >= 'a' && digit <= 'z') {
+    return digit - 'a' + 26;
+  }
+
+  if (digit >= '0' && digit <= '9') {
+    return digit - '0' + 52;
+  }
+
+  // both the standard and the URL safe alphabets
+  if (digit == '+' || digit == '-') {
+    return 62;
+  }
+
+  if (digit == '/' || digit == '_') {
+    return 63;
+  }
+
+  return -1;
+}
+
+// Bytes fields are printed in base64. Appends the decoded bytes to output,
+// or returns false if text is not base64.
+bool appendBase64(std::string_view text, std::string& output) {
+  while (!text.empty() && text.back() == '=') {
+    text.remove_suffix(1);
+  }
+
+  if (text.size() % 4 == 1) {
+    return false;
+  }
+
+  std::uint32_t bits = 0;
+  int bit_count = 0;
+  for (auto digit : text) {
+    auto value = getBase64Value(digit);
+    if (value < 0) {
+      return false;
+    }
+
+    bits = (bits << 6) | static_cast<std::uint32_t>(value);
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      output.push_back(static_cast<char>((bits >> bit_count) & 0xFF));
+    }
+  }
+
+  return true;
+}
+
+// Reads a Timestamp printed as RFC 3339 in UTC
+void setJsonTime(const rapidjson::Value* value,
+                 bool processed,
+                 ExecutionEntry& entry) {
+  auto text = getString(value);
+
+  std::int64_t seconds;
+  if (!parseLogTimestamp(text, seconds)) {
+    return;
+  }
+
+  std::int64_t nanos = 0;
+  if (text.size() > 20 && text[19] == '.') {
+    std::int64_t scale = 100000000;
+    for (size_t i = 20; i < text.size() && text[i] >= '0' && text[i] <= '9';
+         ++i) {
+      nanos += (text[i] - '0') * scale;
+      scale /= 10;
+    }
+  }
+
+  entry.setTime(seconds, nanos, processed);
+}
+
+// Like in the wire format, zero values are left out of the messages that
+// are there
+void decodeJsonProcess(const rapidjson::Value* process, ExecutionEntry& entry) {
+  auto id = getMember(process, kJsonId);
+  setJsonNumber(id, getMember(id, kJsonPid), kLogFieldPid, entry);
+
+  auto original_parent_pid = getMember(process, kJsonOriginalParentPid);
+  if (original_parent_pid != nullptr) {
+    setJsonNumber(process, original_parent_pid, kLogFieldPpid, entry);
+  } else {
+    auto parent_id = getMember(process, kJsonParentId);
+    setJsonNumber(
+        parent_id, getMember(parent_id, kJsonPid), kLogFieldPpid, entry);
+  }
+
+  auto user = getMember(process, kJsonEffectiveUser);
+  setJsonNumber(user, getMember(user, kJsonUid), kLogFieldUid, entry);
+  entry.view.fields[kLogFieldUser] = getString(getMember(user, kJsonName));
+
+  auto group = getMember(process, kJsonEffectiveGroup);
+  setJsonNumber(group, getMember(group, kJsonGid), kLogFieldGid, entry);
+  entry.view.fields[kLogFieldGroup] = getString(getMember(group, kJsonName));
+
+  auto signature = getMember(process, kJsonCodeSignature);
+  entry.view.fields[kLogFieldSigningId] =
+      getString(getMember(signature, kJsonSigningId));
+  entry.view.fields[kLogFieldTeamId] =
+      getString(getMember(signature, kJsonTeamId));
+
+  auto cdhash = getString(getMember(signature, kJsonCdhash));
+  std::string cdhash_bytes;
+  if (appendBase64(cdhash, cdhash_bytes)) {
+    entry.setHex(kLogFieldCdhash, cdhash_bytes);
+  } else {
+    entry.view.fields[kLogFieldCdhash] = cdhash;
+  }
+
+  auto executable = getMember(process, kJsonExecutable);
+  entry.view.fields[kLogFieldPath] = getString(getMember(executable, kJsonPath));
+  entry.view.fields[kLogFieldSha256] =
+      getString(getMember(getMember(executable, kJsonHash), kJsonHash));
+}
+
+// Decodes the execution of a SantaMessage. Returns false when it holds none;
+// its time is decoded either way.
+bool decodeJsonMessage(const rapidjson::Value& message, ExecutionEntry& entry) {
+  setJsonTime(getMember(&message, kJsonEventTime), false, entry);
+  setJsonTime(getMember(&message, kJsonProcessedTime), true, entry);
+
+  auto execution = getMember(&message, kJsonExecution);
+  if (execution == nullptr || !execution->IsObject()) {
+    return false;
+  }
+
+  entry.decision = getJsonEnum(getMember(execution, kJsonDecision),
+                               kDecisionNames);
+  entry.view.fields[kLogFieldReason] = getLogName(
+      kReasonNames, getJsonEnum(getMember(execution, kJsonReason), kReasonNames));
+  entry.view.fields[kLogFieldMode] = getLogName(
+      kModeNames, getJsonEnum(getMember(execution, kJsonMode), kModeNames));
+  entry.view.fields[kLogFieldExplain] =
+      getString(getMember(execution, kJsonExplain));
+
+  auto certificate = getMember(execution, kJsonCertificateInfo);
+  entry.view.fields[kLogFieldCertSha256] =
+      getString(getMember(getMember(certificate, kJsonHash), kJsonHash));
+  entry.view.fields[kLogFieldCertCommonName] =
+      getString(getMember(certificate, kJsonCommonName));
+
+  decodeJsonProcess(getMember(execution, kJsonTarget), entry);
+
+  auto& args = entry.formatted[kLogFieldArgs];
+  args.clear();
+  auto arg_values = getMember(execution, kJsonArgs);
+  if (arg_values != nullptr && arg_values->IsArray()) {
+    for (const auto& arg : arg_values->GetArray()) {
+      if (!args.empty()) {
+        args.push_back(' ');
+      }
+
+      auto text = getString(&arg);
+      auto size = args.size();
+      if (!appendBase64(text, args)) {
+        args.resize(size);
+        args.append(text);
+      }
+    }
+  }
+
+  entry.view.fields[kLogFieldArgs] = args;
+  return true;
+}
+
+// Santa's JSON event log: one SantaMessage per line of santa.log
+class JsonLogSource final : public LineLogSource {
+ public:
+  void decode(std::string_view data,
+              const SantaEventTypeSet& types,
+              const PathMatcher* path_matcher,
+              const LogEventCallback& callback) const override {
+    if (!types.test(kAllowed) && !types.test(kDenied)) {
+      return;
+    }
+
+    // Lines without an execution are skipped by the vectorized search and
+    // never parsed
+    ExecutionEntry entry;
+    rapidjson::Document document;
+    size_t line_start = 0;
+    size_t marker_pos;
+    while ((marker_pos = findLogMarker(data, line_start, kJsonExecutionMarker)) !=
+           std::string_view::npos) {
+      size_t start = marker_pos;
+      while (start > line_start && data[start - 1] != '\n') {
+        --start;
+      }
+
+      size_t end = data.find('\n', marker_pos);
+      auto line = data.substr(start, end - start);
+
+      document.Parse(line.data(), line.size());
+      entry.reset();
+      if (!document.HasParseError() && decodeJsonMessage(document, entry)) {
+        emitExecution(entry, types, path_matcher, callback);
+      }
+
+      if (end == std::string_view::npos) {
+        break;
+      }
+
+      line_start = end + 1;
+    }
+  }
+
+  std::int64_t getFirstRecordTime(std::string_view data) const override {
+    auto line = data.substr(0, data.find('\n'));
+
+    rapidjson::Document document;
+    document.Parse(line.data(), line.size());
+
+    ExecutionEntry entry;
+    if (!document.HasParseError()) {
+      decodeJsonMessage(document, entry);
+    }
+
+    return entry.view.time;
+  }
+};
+
+} // namespace
+
+std::unique_ptr<LogSource> createJsonLogSource() {
+  return std::make_unique<JsonLogSource>();
+}
+
+std::unique_ptr<LogSource> createProtobufLogSource() {
+  return std::make_unique<ProtobufLogSource>();
+}
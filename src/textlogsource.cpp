@@ -0,0 +1,118 @@
+#include "logsource.h"
+
+#include "logscanner.h"
+
+namespace {
+
+constexpr std::string_view kLogEntryPreface = "santad: ";
+
+// Extracts the timestamp and the wanted fields of a log line, stopping as soon
+// as all of them have been found
+void extractValues(std::string_view line,
+                   LogEntryView& values,
+                   const LogFieldSet& wanted) {
+  values = {};
+
+  // extract timestamp
+  size_t timestamp_start = line.find('[');
+  size_t timestamp_end = line.find(']');
+
+  if (timestamp_start != std::string_view::npos &&
+      timestamp_end != std::string_view::npos &&
+      timestamp_start != timestamp_end) {
+    values.timestamp =
+        line.substr(timestamp_start + 1, timestamp_end - timestamp_start - 1);
+  }
+
+  // extract key=value pairs after the kLogEntryPreface
+  size_t key_pos = line.find(kLogEntryPreface);
+  if (key_pos == std::string_view::npos) {
+    return;
+  }
+
+  auto missing = wanted;
+
+  key_pos += kLogEntryPreface.length();
+  size_t key_end, val_pos, val_end;
+  while (missing.any() &&
+         (key_end = line.find('=', key_pos)) != std::string_view::npos) {
+    if ((val_pos = line.find_first_not_of('=', key_end)) ==
+        std::string_view::npos) {
+      break;
+    }
+
+    val_end = line.find('|', val_pos);
+
+    // the first occurrence of a key wins
+    auto field = getLogFieldIndex(line.substr(key_pos, key_end - key_pos));
+    if (field != kLogFieldCount && missing.test(field)) {
+      values.fields[field] = line.substr(val_pos, val_end - val_pos);
+      missing.reset(field);
+    }
+
+    key_pos = val_end;
+    if (key_pos != std::string_view::npos)
+      ++key_pos;
+  }
+}
+
+// Reads only the timestamp of a log line, 0 if it has none
+std::int64_t getLineTime(std::string_view line) {
+  LogEntryView values;
+  extractValues(line, values, LogFieldSet());
+
+  std::int64_t time;
+  return parseLogTimestamp(values.timestamp, time) ? time : 0;
+}
+
+// Tells whether the path of a log line matches. The automaton runs over the
+// raw line first, and only the lines holding every literal fragment of the
+// patterns have their path extracted.
+bool lineMatchesPath(std::string_view line, const PathMatcher& matcher) {
+  if (!matcher.mayMatch(line)) {
+    return false;
+  }
+
+  LogEntryView values;
+  extractValues(line, values, LogFieldSet().set(kLogFieldPath));
+  return matcher.matches(values.fields[kLogFieldPath]);
+}
+
+// Santa's text log, where each line is an event of key=value pairs
+class TextLogSource final : public LineLogSource {
+ public:
+  void decode(std::string_view data,
+              const SantaEventTypeSet& types,
+              const PathMatcher* path_matcher,
+              const LogEventCallback& callback) const override {
+    scanEventLines(
+        data, types, [&](std::string_view line, SantaEventType type) {
+          if (path_matcher == nullptr || lineMatchesPath(line, *path_matcher)) {
+            callback(type, parseLogLine(line));
+          }
+        });
+  }
+
+  std::int64_t getFirstRecordTime(std::string_view data) const override {
+    return getLineTime(data.substr(0, data.find('\n')));
+  }
+};
+
+} // namespace
+
+LogEntryView parseLogLine(std::string_view line) {
+  // Entries are cached for later queries, which may need any field
+  static const auto all_fields = LogFieldSet().set();
+
+  LogEntryView entry;
+  extractValues(line, entry, all_fields);
+  if (!parseLogTimestamp(entry.timestamp, entry.time)) {
+    entry.time = 0;
+  }
+
+  return entry;
+}
+
+std::unique_ptr<LogSource> createTextLogSource() {
+  return std::make_unique<TextLogSource>();
+}
@@ -1,8 +1,11 @@
 #include "utils.h"
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdio>
 #include <memory>
 #include <string>
+#include <thread>
 #include <osquery/logger/logger.h>
 
 bool ExecuteProcess(ProcessOutput& output,
@@ -58,4 +61,32 @@ bool ExecuteProcess(ProcessOutput& output,
     VLOG(1) << "Unknown exception in ExecuteProcess";
     return false;
   }
-}
\ No newline at end of file
+}
+
+void runInParallel(const std::vector<std::function<void()>>& tasks,
+                   size_t max_threads) {
+  std::atomic<size_t> next_task(0U);
+  auto worker = [&tasks, &next_task]() {
+    size_t task;
+    while ((task = next_task++) < tasks.size()) {
+      try {
+        tasks[task]();
+      } catch (const std::exception& e) {
+        VLOG(1) << "Exception in worker task: " << e.what();
+      }
+    }
+  };
+
+  size_t thread_count = std::min(std::max<size_t>(max_threads, 1U), tasks.size());
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  worker();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
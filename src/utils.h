@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -13,3 +15,8 @@ struct ProcessOutput final {
 bool ExecuteProcess(ProcessOutput& output,
                     const std::string& path,
                     const std::vector<std::string>& args);
+
+// Runs every task to completion on at most max_threads threads, the calling
+// thread included. Tasks are picked up in order as threads become free.
+void runInParallel(const std::vector<std::function<void()>>& tasks,
+                   size_t max_threads);
@@ -0,0 +1,392 @@
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "archiveindex.h"
+#include "decisionstore.h"
+#include "logsource.h"
+
+namespace {
+
+// Two regular decisions, then values that do not have the form the store
+// packs them in and are kept on the side: an uppercase SHA-256, one of all
+// zeroes, which stands for an empty field, a timestamp that does not parse
+// and one whose milliseconds are missing.
+const std::vector<std::string> kLogLines = {
+    "[2026-10-29T17:10:30.849Z] I santad: action=EXEC|decision=ALLOW|"
+    "reason=BINARY|sha256="
+    "6f07fd29c425d83b2a4e9495a9b852f0a4156a17e9ab113aac244b882b2af354|"
+    "pid=53192|ppid=1|uid=501|user=bob|gid=20|group=staff|mode=L|"
+    "path=/Users/bob/Downloads/allowed|args=allowed -x",
+    "[2026-10-29T17:11:18.488Z] I santad: action=EXEC|decision=DENY|"
+    "reason=BINARY|sha256="
+    "d134cb77953e939bb6df90690e48c317be52bdd1e68a29d3c832109b2b9dde80|"
+    "pid=51279|ppid=1|uid=501|user=bob|gid=20|group=staff|mode=L|"
+    "path=/Users/bob/Downloads/denied|args=denied",
+    "[2026-10-29T17:12:00.000Z] I santad: action=EXEC|decision=DENY|"
+    "reason=BINARY|sha256="
+    "D134CB77953E939BB6DF90690E48C317BE52BDD1E68A29D3C832109B2B9DDE80|"
+    "pid=51280|path=/Users/bob/Downloads/denied",
+    "[2026-10-29T17:12:01.000Z] I santad: action=EXEC|decision=DENY|"
+    "reason=BINARY|sha256="
+    "0000000000000000000000000000000000000000000000000000000000000000|"
+    "pid=51281|path=/Users/bob/Downloads/zeroes",
+    "[yesterday] I santad: action=EXEC|decision=DENY|reason=CERT|"
+    "pid=51282|path=/Users/bob/Downloads/undated",
+    "[2026-10-29T17:12:02Z] I santad: action=EXEC|decision=DENY|"
+    "reason=CERT|pid=51283|path=/Users/bob/Downloads/whole_second",
+};
+
+std::vector<LogEntry> getLogEntries() {
+  std::vector<LogEntry> entries;
+  for (const auto& line : kLogLines) {
+    auto view = parseLogLine(line);
+
+    LogEntry entry;
+    entry.timestamp = std::string(view.timestamp);
+    entry.time = view.time;
+    for (size_t i = 0; i < kLogFieldCount; ++i) {
+      entry.fields[i] = std::string(view.fields[i]);
+    }
+
+    entries.push_back(std::move(entry));
+  }
+
+  return entries;
+}
+
+DecisionStore createStore() {
+  DecisionStore store;
+  for (const auto& line : kLogLines) {
+    store.add(parseLogLine(line));
+  }
+
+  return store;
+}
+
+std::vector<LogEntry> collectAll(const DecisionStore& store) {
+  LogEntries entries;
+  store.collect(entries, DecisionFilter());
+  return std::vector<LogEntry>(entries.begin(), entries.end());
+}
+
+void expectSameEntries(const std::vector<LogEntry>& entries,
+                       const std::vector<LogEntry>& expected_entries) {
+  ASSERT_EQ(entries.size(), expected_entries.size());
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(entries[i].timestamp, expected_entries[i].timestamp)
+        << "Entry " << i;
+    EXPECT_EQ(entries[i].time, expected_entries[i].time) << "Entry " << i;
+
+    for (size_t j = 0; j < kLogFieldCount; ++j) {
+      EXPECT_EQ(entries[i].fields[j], expected_entries[i].fields[j])
+          << "Entry " << i << ", field " << kLogFields[j].key;
+    }
+  }
+}
+
+// Runs every test reading the stores back into owned columns, then in place
+// from a buffer standing in for the mapped archive index
+class DecisionStoreTests : public testing::TestWithParam<bool> {
+ protected:
+  // Serializes the store and reads it back the way the test runs
+  bool roundTrip(const DecisionStore& store, DecisionStore& copy) {
+    auto buffer = std::make_shared<std::string>();
+    store.serialize(*buffer);
+
+    std::string_view input(*buffer);
+    std::shared_ptr<const void> mapping;
+    if (GetParam()) {
+      mapping = buffer;
+    }
+
+    if (!copy.deserialize(input, mapping)) {
+      return false;
+    }
+
+    EXPECT_TRUE(input.empty());
+    return true;
+  }
+};
+
+TEST_P(DecisionStoreTests, test_round_trip_keeps_the_entries) {
+  auto store = createStore();
+
+  DecisionStore copy;
+  ASSERT_TRUE(roundTrip(store, copy));
+
+  EXPECT_EQ(copy.size(), store.size());
+  EXPECT_EQ(copy.minTime(), store.minTime());
+  EXPECT_EQ(copy.maxTime(), store.maxTime());
+  expectSameEntries(collectAll(copy), getLogEntries());
+}
+
+TEST_P(DecisionStoreTests, test_round_trip_keeps_the_irregular_values) {
+  DecisionStore copy;
+  ASSERT_TRUE(roundTrip(createStore(), copy));
+
+  auto entries = collectAll(copy);
+  ASSERT_EQ(entries.size(), kLogLines.size());
+
+  EXPECT_EQ(entries[2].fields[kLogFieldSha256],
+            "D134CB77953E939BB6DF90690E48C317BE52BDD1E68A29D3C832109B2B9DDE80");
+  EXPECT_EQ(entries[3].fields[kLogFieldSha256], std::string(64, '0'));
+  EXPECT_TRUE(entries[4].fields[kLogFieldSha256].empty());
+
+  EXPECT_EQ(entries[4].timestamp, "yesterday");
+  EXPECT_EQ(entries[4].time, 0);
+  EXPECT_EQ(entries[5].timestamp, "2026-10-29T17:12:02Z");
+}
+
+TEST_P(DecisionStoreTests, test_round_trip_copy_accepts_new_entries) {
+  DecisionStore copy;
+  ASSERT_TRUE(roundTrip(createStore(), copy));
+
+  // Appending to the columns read back, borrowed ones included, must leave
+  // the entries already in them as they were
+  copy.add(parseLogLine(kLogLines[0]));
+  copy.append(createStore());
+
+  std::vector<LogEntry> expected_entries;
+  auto entries = getLogEntries();
+  expected_entries.insert(
+      expected_entries.end(), entries.begin(), entries.end());
+  expected_entries.push_back(entries[0]);
+  expected_entries.insert(
+      expected_entries.end(), entries.begin(), entries.end());
+
+  expectSameEntries(collectAll(copy), expected_entries);
+
+  // And so must reading the grown store back once more
+  DecisionStore second_copy;
+  ASSERT_TRUE(roundTrip(copy, second_copy));
+  expectSameEntries(collectAll(second_copy), expected_entries);
+}
+
+TEST_P(DecisionStoreTests, test_filters_on_sha256_and_path) {
+  auto original = createStore();
+  DecisionStore copy;
+  ASSERT_TRUE(roundTrip(original, copy));
+
+  const std::string denied_sha256 =
+      "d134cb77953e939bb6df90690e48c317be52bdd1e68a29d3c832109b2b9dde80";
+  const std::string uppercase_sha256 =
+      "D134CB77953E939BB6DF90690E48C317BE52BDD1E68A29D3C832109B2B9DDE80";
+  const std::string denied_path = "/Users/bob/Downloads/denied";
+
+  // The pids of the matching entries, in store order
+  auto getPids = [](const DecisionStore& store,
+                    const std::set<std::string>& sha256s,
+                    const std::set<std::string>& paths) {
+    DecisionFilter filter;
+    filter.sha256s = sha256s;
+    filter.paths = paths;
+
+    LogEntries entries;
+    store.collect(entries, filter);
+
+    std::vector<std::string> pids;
+    for (const auto& entry : entries) {
+      pids.push_back(entry.fields[getLogFieldIndex("pid")]);
+    }
+
+    return pids;
+  };
+
+  using Pids = std::vector<std::string>;
+  for (const auto* store : {&original, &copy}) {
+    EXPECT_EQ(getPids(*store, {denied_sha256}, {}), Pids({"51279"}));
+    EXPECT_EQ(getPids(*store, {uppercase_sha256}, {}), Pids({"51280"}));
+    EXPECT_EQ(getPids(*store, {std::string(64, '0')}, {}), Pids({"51281"}));
+    EXPECT_EQ(getPids(*store, {""}, {}), Pids({"51282", "51283"}));
+    EXPECT_EQ(getPids(*store, {"unknown"}, {}), Pids());
+
+    EXPECT_EQ(getPids(*store, {}, {denied_path}), Pids({"51279", "51280"}));
+    EXPECT_EQ(getPids(*store, {}, {"/unknown"}), Pids());
+    EXPECT_EQ(getPids(*store, {}, {"/users/bob/downloads/denied"}), Pids());
+
+    EXPECT_EQ(getPids(*store,
+                      {denied_sha256, uppercase_sha256, ""},
+                      {denied_path, "/Users/bob/Downloads/undated"}),
+              Pids({"51279", "51280", "51282"}));
+
+    DecisionFilter filter;
+    filter.paths = {denied_path};
+    DecisionSummaries summaries;
+    store->summarize(summaries, filter);
+    ASSERT_EQ(summaries.size(), 2U);
+    EXPECT_EQ(summaries.count(denied_sha256 + '\0' + denied_path), 1U);
+    EXPECT_EQ(summaries.count(uppercase_sha256 + '\0' + denied_path), 1U);
+  }
+}
+
+TEST_P(DecisionStoreTests, test_round_trip_rejects_a_truncated_store) {
+  std::string buffer;
+  createStore().serialize(buffer);
+
+  for (auto size : {size_t{0}, buffer.size() / 2, buffer.size() - 1}) {
+    auto truncated = std::make_shared<std::string>(buffer, 0, size);
+    std::string_view input(*truncated);
+
+    std::shared_ptr<const void> mapping;
+    if (GetParam()) {
+      mapping = truncated;
+    }
+
+    DecisionStore copy;
+    EXPECT_FALSE(copy.deserialize(input, mapping)) << "Size " << size;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(ReadModes,
+                         DecisionStoreTests,
+                         testing::Values(false, true),
+                         [](const testing::TestParamInfo<bool>& info) {
+                           return info.param ? "InPlace" : "Copied";
+                         });
+
+TEST(StoreColumnTests, test_borrowed_values_are_copied_on_first_write) {
+  std::vector<std::int64_t> values = {1, 2, 3};
+
+  StoreColumn<std::int64_t> column;
+  column.borrow(values.data(), values.size());
+  EXPECT_EQ(column.begin(), values.data());
+
+  column.push_back(4);
+  EXPECT_NE(column.begin(), values.data());
+
+  // The column no longer depends on the values it borrowed
+  values.assign(values.size(), 0);
+  EXPECT_EQ(std::vector<std::int64_t>(column.begin(), column.end()),
+            std::vector<std::int64_t>({1, 2, 3, 4}));
+}
+
+// Saves and loads the archive index in a temporary directory
+class ArchiveIndexTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    char directory[] = "/tmp/santa_archiveindex_tests.XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+
+    directory_ = directory;
+    index_path_ = directory_ + "/santa_archive.idx";
+
+    auto partitions = std::make_shared<EventPartitions>();
+    (*partitions)[kDenied] = createStore();
+    archives_[kArchive] = partitions;
+    evicted_archives_.insert(kEvictedArchive);
+  }
+
+  void TearDown() override {
+    std::remove(index_path_.c_str());
+    rmdir(directory_.c_str());
+  }
+
+  std::string readIndex() const {
+    std::ifstream file(index_path_, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  }
+
+  void writeIndex(const std::string& contents) const {
+    std::ofstream file(index_path_, std::ios::binary | std::ios::trunc);
+    file << contents;
+  }
+
+  // Loads the index and checks that it was either restored or left empty
+  bool loadIndex(const SantaEventTypeSet& event_types) const {
+    ArchiveCache archives;
+    std::set<ArchiveFingerprint> evicted_archives;
+    auto loaded = loadArchiveIndex(
+        index_path_, event_types, archives, evicted_archives);
+
+    if (!loaded) {
+      EXPECT_TRUE(archives.empty());
+      EXPECT_TRUE(evicted_archives.empty());
+      return false;
+    }
+
+    EXPECT_EQ(evicted_archives, evicted_archives_);
+    EXPECT_EQ(archives.size(), 1U);
+    auto archive_it = archives.find(kArchive);
+    if (archive_it == archives.end()) {
+      ADD_FAILURE() << "Missing archive";
+      return true;
+    }
+
+    auto store_it = archive_it->second->find(kDenied);
+    if (store_it == archive_it->second->end()) {
+      ADD_FAILURE() << "Missing partition";
+      return true;
+    }
+
+    expectSameEntries(collectAll(store_it->second), getLogEntries());
+    return true;
+  }
+
+  const ArchiveFingerprint kArchive{1234, 5678, 1761757830, 0xC0FFEE};
+  const ArchiveFingerprint kEvictedArchive{4321, 8765, 1761671430, 0xBEEF};
+  const SantaEventTypeSet kEventTypes{SantaEventTypeSet().set(kDenied)};
+
+  // The index header starts with an 8 byte magic and a 4 byte version,
+  // followed by the schema checksum
+  static constexpr size_t kSchemaOffset = 12;
+
+  std::string directory_;
+  std::string index_path_;
+  ArchiveCache archives_;
+  std::set<ArchiveFingerprint> evicted_archives_;
+};
+
+TEST_F(ArchiveIndexTests, test_saved_index_loads_back) {
+  ASSERT_TRUE(saveArchiveIndex(
+      index_path_, kEventTypes, archives_, evicted_archives_));
+
+  EXPECT_TRUE(loadIndex(kEventTypes));
+}
+
+TEST_F(ArchiveIndexTests, test_index_lacking_event_types_is_ignored) {
+  ASSERT_TRUE(saveArchiveIndex(
+      index_path_, kEventTypes, archives_, evicted_archives_));
+
+  EXPECT_FALSE(loadIndex(SantaEventTypeSet(kEventTypes).set(kAllowed)));
+}
+
+TEST_F(ArchiveIndexTests, test_index_with_a_bad_checksum_is_ignored) {
+  ASSERT_TRUE(saveArchiveIndex(
+      index_path_, kEventTypes, archives_, evicted_archives_));
+
+  auto contents = readIndex();
+  ASSERT_FALSE(contents.empty());
+  contents.back() ^= 0x01;
+  writeIndex(contents);
+
+  EXPECT_FALSE(loadIndex(kEventTypes));
+}
+
+TEST_F(ArchiveIndexTests, test_index_of_another_schema_is_ignored) {
+  ASSERT_TRUE(saveArchiveIndex(
+      index_path_, kEventTypes, archives_, evicted_archives_));
+
+  auto contents = readIndex();
+  ASSERT_GT(contents.size(), kSchemaOffset);
+  contents[kSchemaOffset] ^= 0x01;
+  writeIndex(contents);
+
+  EXPECT_FALSE(loadIndex(kEventTypes));
+}
+
+} // namespace
@@ -0,0 +1,16 @@
+
+
+,type.googleapis.com/santa.pb.v1.SantaMessageR
+ȟ :bobJ	staffj>
+):K\m~#4ABCDE12345:com.bob.allowed
+ABCDE12345zd
+/Users/bob/Downloads/allowed"D@6f07fd29c425d83b2a4e9495a9b852f0a4156a17e9ab113aac244b882b2af354*allowed*-xHPXbr
+D@3c1d5b1b6cb8e3a9bd0d2e70df5d74e8c7a1a3c1d0d8c0ff7f4c2a6f6d1b9e0a*Developer ID Application: Bob (ABCDE12345)
+B
+,type.googleapis.com/santa.pb.v1.SantaMessageZ
+
+ɟ
+
+,type.googleapis.com/santa.pb.v1.SantaMessageR
+ϐ:bobJ	staffzc
+/Users/bob/Downloads/denied"D@d134cb77953e939bb6df90690e48c317be52bdd1e68a29d3c832109b2b9dde80*deniedHPXjBlocked by a binary rule
\ No newline at end of file
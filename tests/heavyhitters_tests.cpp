@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "heavyhitters.h"
+
+namespace {
+
+const size_t kWidth = 1024;
+const size_t kDepth = 4;
+
+// A shuffled stream of a few frequent keys, in decreasing order of their
+// counts, among many keys seen once or twice
+class HeavyHittersTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    const std::uint64_t frequent_counts[] = {900, 700, 500, 300, 100};
+    for (size_t i = 0; i < 5; ++i) {
+      auto key = "frequent" + std::to_string(i);
+      frequent_keys_.push_back(key);
+      counts_[key] = frequent_counts[i];
+    }
+
+    for (size_t i = 0; i < 3000; ++i) {
+      counts_["rare" + std::to_string(i)] = 1 + i % 2;
+    }
+
+    for (const auto& count : counts_) {
+      stream_.insert(stream_.end(), count.second, count.first);
+    }
+
+    std::mt19937 generator(42);
+    std::shuffle(stream_.begin(), stream_.end(), generator);
+  }
+
+  std::vector<std::string> frequent_keys_;
+  std::map<std::string, std::uint64_t> counts_;
+  std::vector<std::string> stream_;
+};
+
+TEST_F(HeavyHittersTests, test_estimates_are_never_too_low) {
+  CountMinSketch sketch(kWidth, kDepth);
+  for (const auto& key : stream_) {
+    sketch.add(key);
+  }
+
+  EXPECT_EQ(sketch.total(), stream_.size());
+
+  // The error bound only holds with some probability, which is high enough
+  // for this stream to stay within it
+  auto error_bound =
+      static_cast<std::uint64_t>(sketch.errorRate() * sketch.total());
+  size_t beyond_bound = 0;
+  for (const auto& count : counts_) {
+    auto estimate = sketch.estimate(count.first);
+    EXPECT_GE(estimate, count.second) << count.first;
+
+    if (estimate > count.second + error_bound) {
+      ++beyond_bound;
+    }
+  }
+
+  EXPECT_LE(beyond_bound,
+            static_cast<size_t>((1.0 - sketch.confidence()) * counts_.size()));
+}
+
+TEST_F(HeavyHittersTests, test_merged_sketches_estimate_the_whole_stream) {
+  CountMinSketch whole(kWidth, kDepth);
+  CountMinSketch first_half(kWidth, kDepth);
+  CountMinSketch second_half(kWidth, kDepth);
+  for (size_t i = 0; i < stream_.size(); ++i) {
+    whole.add(stream_[i]);
+    (i < stream_.size() / 2 ? first_half : second_half).add(stream_[i]);
+  }
+
+  first_half.merge(second_half);
+  EXPECT_EQ(first_half.total(), whole.total());
+  for (const auto& count : counts_) {
+    EXPECT_EQ(first_half.estimate(count.first), whole.estimate(count.first))
+        << count.first;
+  }
+
+  // Sketches of other dimensions are not merged
+  CountMinSketch narrower(kWidth / 2, kDepth);
+  narrower.merge(whole);
+  EXPECT_EQ(narrower.total(), 0U);
+  EXPECT_EQ(narrower.estimate(frequent_keys_[0]), 0U);
+}
+
+TEST_F(HeavyHittersTests, test_keeps_the_most_frequent_keys) {
+  HeavyHitters heavy_hitters(frequent_keys_.size(), kWidth, kDepth);
+  for (const auto& key : stream_) {
+    heavy_hitters.add(key);
+  }
+
+  // Ordered by their estimates, as santa_topk reports them
+  auto keys = heavy_hitters.keys();
+  const auto& sketch = heavy_hitters.sketch();
+  std::sort(keys.begin(),
+            keys.end(),
+            [&sketch](const std::string& first, const std::string& second) {
+              return sketch.estimate(first) > sketch.estimate(second);
+            });
+
+  EXPECT_EQ(keys, frequent_keys_);
+}
+
+TEST_F(HeavyHittersTests, test_late_frequent_key_replaces_a_held_one) {
+  HeavyHitters heavy_hitters(2, kWidth, kDepth);
+  for (size_t i = 0; i < 100; ++i) {
+    heavy_hitters.add("early");
+  }
+
+  for (const auto& key : stream_) {
+    if (key.compare(0, 4, "rare") == 0) {
+      heavy_hitters.add(key);
+    }
+  }
+
+  for (size_t i = 0; i < 50; ++i) {
+    heavy_hitters.add("late");
+  }
+
+  auto keys = heavy_hitters.keys();
+  EXPECT_EQ(std::set<std::string>(keys.begin(), keys.end()),
+            std::set<std::string>({"early", "late"}));
+}
+
+} // namespace
@@ -0,0 +1,151 @@
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "logsource.h"
+
+namespace {
+
+// The same three events in every format Santa logs in: an allowed execution
+// of a signed binary whose parent was reparented, a fork, and a denied
+// execution of an unsigned binary. santa_spool.pb is a LogBatch of three
+// SantaMessages, santa.json the same messages one per line, the second in
+// protobuf's lowerCamelCase with some numbers printed as strings the way 64
+// bit integers are. santa.log is what the text log holds for them.
+const std::string kFixturesDir = SANTA_TEST_FIXTURES_DIR;
+
+struct DecodedEvent final {
+  SantaEventType type;
+  LogEntry entry;
+
+  bool operator==(const DecodedEvent& other) const {
+    return type == other.type && entry.timestamp == other.entry.timestamp &&
+           entry.time == other.entry.time &&
+           entry.fields == other.entry.fields;
+  }
+};
+
+std::ostream& operator<<(std::ostream& stream, const DecodedEvent& event) {
+  stream << (event.type == kDenied ? "DENY" : "ALLOW") << " ["
+         << event.entry.timestamp << "] " << event.entry.time;
+  for (size_t i = 0; i < kLogFieldCount; ++i) {
+    stream << " " << kLogFields[i].key << "=" << event.entry.fields[i];
+  }
+
+  return stream;
+}
+
+std::string readFixture(const std::string& name) {
+  std::ifstream file(kFixturesDir + "/" + name, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+std::vector<DecodedEvent> decodeFixture(const LogSource& source,
+                                        const std::string& name) {
+  auto data = readFixture(name);
+  EXPECT_FALSE(data.empty()) << "Missing fixture " << name;
+  EXPECT_EQ(source.getCompleteSize(data), data.size());
+
+  std::vector<DecodedEvent> events;
+  source.decode(data,
+                SantaEventTypeSet().set(kAllowed).set(kDenied),
+                nullptr,
+                [&events](SantaEventType type, const LogEntryView& view) {
+                  DecodedEvent event;
+                  event.type = type;
+                  event.entry.timestamp = std::string(view.timestamp);
+                  event.entry.time = view.time;
+                  for (size_t i = 0; i < kLogFieldCount; ++i) {
+                    event.entry.fields[i] = std::string(view.fields[i]);
+                  }
+
+                  events.push_back(std::move(event));
+                });
+
+  return events;
+}
+
+struct StructuredFormat final {
+  const char* name;
+  std::unique_ptr<LogSource> (*create)();
+  const char* fixture;
+};
+
+std::ostream& operator<<(std::ostream& stream,
+                         const StructuredFormat& format) {
+  return stream << format.name;
+}
+
+class StructuredLogSourceTests
+    : public testing::TestWithParam<StructuredFormat> {};
+
+TEST_P(StructuredLogSourceTests, test_decodes_the_text_log_fields) {
+  auto text_events = decodeFixture(*createTextLogSource(), "santa.log");
+  ASSERT_EQ(text_events.size(), 2U);
+
+  auto source = GetParam().create();
+  auto events = decodeFixture(*source, GetParam().fixture);
+  ASSERT_EQ(events.size(), text_events.size());
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(events[i], text_events[i]) << "Event " << i;
+  }
+}
+
+TEST_P(StructuredLogSourceTests, test_decodes_the_fields_text_reports) {
+  auto source = GetParam().create();
+  auto events = decodeFixture(*source, GetParam().fixture);
+  ASSERT_EQ(events.size(), 2U);
+
+  const auto& allowed = events[0];
+  EXPECT_EQ(allowed.type, kAllowed);
+
+  // Milliseconds are truncated from the nanoseconds
+  EXPECT_EQ(allowed.entry.timestamp, "2026-10-29T17:10:30.849Z");
+
+  // The parent the process was started by, not the one it was reparented to
+  EXPECT_EQ(allowed.entry.fields[getLogFieldIndex("ppid")], "1");
+
+  // The cdhash bytes are printed in hex
+  EXPECT_EQ(allowed.entry.fields[getLogFieldIndex("cdhash")],
+            "a1b2c3d4e5f60718293a4b5c6d7e8f9001122334");
+
+  EXPECT_EQ(allowed.entry.fields[getLogFieldIndex("args")], "allowed -x");
+
+  const auto& denied = events[1];
+  EXPECT_EQ(denied.type, kDenied);
+
+  // Without an original parent, the parent process
+  EXPECT_EQ(denied.entry.fields[getLogFieldIndex("ppid")], "412");
+
+  EXPECT_EQ(denied.entry.fields[getLogFieldIndex("pid")], "51279");
+  EXPECT_EQ(denied.entry.fields[getLogFieldIndex("uid")], "501");
+  EXPECT_TRUE(denied.entry.fields[getLogFieldIndex("cdhash")].empty());
+}
+
+TEST_P(StructuredLogSourceTests, test_reads_the_first_record_time) {
+  auto source = GetParam().create();
+  auto data = readFixture(GetParam().fixture);
+
+  EXPECT_EQ(source->getFirstRecordTime(data),
+            createTextLogSource()->getFirstRecordTime(readFixture("santa.log")));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Formats,
+    StructuredLogSourceTests,
+    testing::Values(
+        StructuredFormat{"json", createJsonLogSource, "santa.json"},
+        StructuredFormat{"protobuf", createProtobufLogSource, "santa_spool.pb"}),
+    [](const testing::TestParamInfo<StructuredFormat>& info) {
+      return info.param.name;
+    });
+
+} // namespace
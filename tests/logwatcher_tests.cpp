@@ -0,0 +1,350 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <osquery/core/flags.h>
+#include <osquery/events/events.h>
+
+#include "logwatcher.h"
+#include "santadecisioneventstable.h"
+#include "santalogpublisher.h"
+
+DECLARE_string(santa_log_path);
+DECLARE_string(santa_log_format);
+DECLARE_uint64(santa_log_watch_interval);
+DECLARE_bool(santa_log_watch_polling);
+
+namespace {
+
+const std::string kAllowLine =
+    "[2026-10-29T17:10:30.849Z] I santad: action=EXEC|decision=ALLOW|"
+    "reason=BINARY|sha256="
+    "6f07fd29c425d83b2a4e9495a9b852f0a4156a17e9ab113aac244b882b2af354|"
+    "pid=53192|ppid=1|uid=501|user=bob|gid=20|group=staff|mode=L|"
+    "path=/Users/bob/Downloads/allowed|args=allowed -x\n";
+
+const std::string kDenyLine =
+    "[2026-10-29T17:11:18.488Z] I santad: action=EXEC|decision=DENY|"
+    "reason=BINARY|sha256="
+    "d134cb77953e939bb6df90690e48c317be52bdd1e68a29d3c832109b2b9dde80|"
+    "pid=51279|ppid=1|uid=501|user=bob|gid=20|group=staff|mode=L|"
+    "path=/Users/bob/Downloads/denied|args=denied\n";
+
+const std::string kWriteLine =
+    "[2026-10-29T17:10:53.000Z] I santad: action=WRITE|path=/tmp/foo|"
+    "pid=3|ppid=1|uid=0|user=root\n";
+
+// How long a notifying watcher is given to wake up. The publisher waits
+// twice as long, so that only a notification gets it going in time.
+const std::chrono::milliseconds kWakeUpTimeout(5000);
+
+// How long the polling watcher sleeps between checks
+const std::chrono::milliseconds kPollingInterval(100);
+
+struct FiredEvent final {
+  SantaEventType type;
+  std::string path;
+
+  bool operator==(const FiredEvent& other) const {
+    return type == other.type && path == other.path;
+  }
+};
+
+std::ostream& operator<<(std::ostream& stream, const FiredEvent& event) {
+  return stream << (event.type == kDenied ? "DENY " : "ALLOW ") << event.path;
+}
+
+// Records what the publisher fires
+class TestSubscriber final
+    : public osquery::EventSubscriber<SantaLogEventPublisher> {
+ public:
+  TestSubscriber() {
+    setName("santa_log_test_events");
+  }
+
+  osquery::Status init() override {
+    auto subscription_context = createSubscriptionContext();
+    subscribe(&TestSubscriber::Callback, subscription_context);
+    return osquery::Status(0, "OK");
+  }
+
+  osquery::Status Callback(
+      const SantaLogEventContextRef& event_context,
+      const SantaLogSubscriptionContextRef& subscription_context) {
+    std::function<void()> action;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      events_.push_back({event_context->type,
+                         event_context->entry.fields[kLogFieldPath]});
+      action = std::move(next_event_action_);
+      next_event_action_ = nullptr;
+    }
+
+    if (action) {
+      action();
+    }
+
+    return osquery::Status(0, "OK");
+  }
+
+  // Runs an action once the next event has been recorded, while the
+  // publisher is still in the middle of reading the log
+  void runOnNextEvent(std::function<void()> action) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_event_action_ = std::move(action);
+  }
+
+  std::vector<FiredEvent> takeEvents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::move(events_);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<FiredEvent> events_;
+  std::function<void()> next_event_action_;
+};
+
+// Runs every test with the platform's notifications, then with polling
+class LogWatcherTests : public testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    char directory[] = "/tmp/santa_logwatcher_tests.XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+
+    directory_ = directory;
+    log_path_ = directory_ + "/santa.log";
+    rotated_path_ = log_path_ + ".0";
+
+    saved_log_path_ = FLAGS_santa_log_path;
+    saved_log_format_ = FLAGS_santa_log_format;
+    saved_watch_interval_ = FLAGS_santa_log_watch_interval;
+    saved_watch_polling_ = FLAGS_santa_log_watch_polling;
+
+    FLAGS_santa_log_path = log_path_;
+    FLAGS_santa_log_format = "text";
+    FLAGS_santa_log_watch_polling = isPolling();
+    FLAGS_santa_log_watch_interval = static_cast<std::uint64_t>(
+        (isPolling() ? kPollingInterval : 2 * kWakeUpTimeout).count());
+
+    // Decisions logged before the publisher started are not fired
+    append(log_path_, kAllowLine + kDenyLine);
+  }
+
+  void TearDown() override {
+    unlink(rotated_path_.c_str());
+    unlink(log_path_.c_str());
+    rmdir(directory_.c_str());
+
+    FLAGS_santa_log_path = saved_log_path_;
+    FLAGS_santa_log_format = saved_log_format_;
+    FLAGS_santa_log_watch_interval = saved_watch_interval_;
+    FLAGS_santa_log_watch_polling = saved_watch_polling_;
+  }
+
+  bool isPolling() const {
+    return GetParam();
+  }
+
+  static void append(const std::string& path, const std::string& lines) {
+    std::ofstream file(path, std::ios::app | std::ios::binary);
+    file << lines;
+  }
+
+  // Moves the log aside the way newsyslog does, before santad reopens it
+  void rotate() {
+    ASSERT_EQ(rename(log_path_.c_str(), rotated_path_.c_str()), 0);
+  }
+
+  // Makes a change from another thread while the watcher waits, and returns
+  // how long the wait took
+  static std::chrono::milliseconds waitForChange(
+      LogWatcher& watcher,
+      std::chrono::milliseconds timeout,
+      const std::function<void()>& change) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread changer([&change]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      change();
+    });
+
+    watcher.wait(timeout);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    changer.join();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+  }
+
+  // A notifying watcher has to wake up for the change, a polling one only
+  // comes back after its interval
+  void expectWakeUp(std::chrono::milliseconds elapsed) {
+    if (isPolling()) {
+      EXPECT_GE(elapsed.count(), kPollingInterval.count());
+    } else {
+      EXPECT_LT(elapsed.count(), kWakeUpTimeout.count());
+    }
+  }
+
+  std::string directory_;
+  std::string log_path_;
+  std::string rotated_path_;
+
+ private:
+  std::string saved_log_path_;
+  std::string saved_log_format_;
+  std::uint64_t saved_watch_interval_{0};
+  bool saved_watch_polling_{false};
+};
+
+TEST_P(LogWatcherTests, test_wait_wakes_up_on_append_and_rotation) {
+  auto watcher = createLogWatcher(log_path_, isPolling());
+  ASSERT_NE(watcher, nullptr);
+
+  auto timeout = isPolling() ? kPollingInterval : 2 * kWakeUpTimeout;
+
+  expectWakeUp(waitForChange(
+      *watcher, timeout, [this]() { append(log_path_, kAllowLine); }));
+
+  expectWakeUp(waitForChange(*watcher, timeout, [this]() {
+    rotate();
+    append(log_path_, kDenyLine);
+  }));
+
+  // The new file is watched as well
+  expectWakeUp(waitForChange(
+      *watcher, timeout, [this]() { append(log_path_, kAllowLine); }));
+}
+
+TEST_P(LogWatcherTests, test_publisher_fires_one_event_per_decision) {
+  auto publisher = std::make_shared<SantaLogEventPublisher>();
+  ASSERT_TRUE(osquery::EventFactory::registerEventPublisher(publisher).ok());
+
+  auto subscriber = std::make_shared<TestSubscriber>();
+  ASSERT_TRUE(osquery::EventFactory::registerEventSubscriber(subscriber).ok());
+
+  // Every decision appended fires once, other actions not at all
+  append(log_path_, kAllowLine + kWriteLine + kDenyLine);
+  auto start = std::chrono::steady_clock::now();
+  publisher->run();
+  expectWakeUp(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start));
+
+  std::vector<FiredEvent> expected_events = {
+      {kAllowed, "/Users/bob/Downloads/allowed"},
+      {kDenied, "/Users/bob/Downloads/denied"}};
+  EXPECT_EQ(subscriber->takeEvents(), expected_events);
+
+  // Lines santad writes to the old file before reopening it are read before
+  // the new file, which is read from its start
+  rotate();
+  append(rotated_path_, kDenyLine);
+  append(log_path_, kWriteLine + kAllowLine);
+
+  start = std::chrono::steady_clock::now();
+  publisher->run();
+  expectWakeUp(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start));
+
+  expected_events = {{kDenied, "/Users/bob/Downloads/denied"},
+                     {kAllowed, "/Users/bob/Downloads/allowed"}};
+  EXPECT_EQ(subscriber->takeEvents(), expected_events);
+
+  osquery::EventFactory::deregisterEventSubscriber(subscriber->getName());
+  osquery::EventFactory::deregisterEventPublisher(publisher->type());
+}
+
+TEST_P(LogWatcherTests, test_publisher_reads_the_old_file_after_rotation) {
+  auto publisher = std::make_shared<SantaLogEventPublisher>();
+  ASSERT_TRUE(osquery::EventFactory::registerEventPublisher(publisher).ok());
+
+  auto subscriber = std::make_shared<TestSubscriber>();
+  ASSERT_TRUE(osquery::EventFactory::registerEventSubscriber(subscriber).ok());
+
+  // The log is rotated while the publisher reads it, and santad writes to
+  // the old file once more before it reopens the log
+  append(log_path_, kAllowLine);
+  subscriber->runOnNextEvent([this]() {
+    rotate();
+    append(rotated_path_, kDenyLine);
+    append(log_path_, kWriteLine + kAllowLine);
+  });
+
+  publisher->run();
+
+  std::vector<FiredEvent> expected_events = {
+      {kAllowed, "/Users/bob/Downloads/allowed"},
+      {kDenied, "/Users/bob/Downloads/denied"},
+      {kAllowed, "/Users/bob/Downloads/allowed"}};
+  EXPECT_EQ(subscriber->takeEvents(), expected_events);
+
+  osquery::EventFactory::deregisterEventSubscriber(subscriber->getName());
+  osquery::EventFactory::deregisterEventPublisher(publisher->type());
+}
+
+TEST_P(LogWatcherTests, test_decision_events_table_returns_the_decisions) {
+  auto publisher = std::make_shared<SantaLogEventPublisher>();
+  ASSERT_TRUE(osquery::EventFactory::registerEventPublisher(publisher).ok());
+
+  auto subscriber = std::make_shared<SantaDecisionEventSubscriber>();
+  subscriber->setName("santa_decision_events");
+  ASSERT_TRUE(osquery::EventFactory::registerEventSubscriber(subscriber).ok());
+
+  append(log_path_, kDenyLine + kWriteLine + kAllowLine);
+  publisher->run();
+
+  SantaDecisionEventsTablePlugin plugin;
+  osquery::TablePlugin& table = plugin;
+
+  std::vector<std::string> column_names;
+  for (const auto& column : table.columns()) {
+    column_names.push_back(std::get<0>(column));
+  }
+
+  osquery::QueryContext context;
+  std::vector<std::pair<std::string, std::string>> decisions;
+  for (const auto& table_row : table.generate(context)) {
+    auto row = static_cast<osquery::Row>(*table_row);
+    for (const auto& column : row) {
+      EXPECT_NE(std::find(column_names.begin(), column_names.end(),
+                          column.first),
+                column_names.end())
+          << "Undeclared column " << column.first;
+    }
+
+    EXPECT_EQ(row["timestamp"].size(), 24U);
+    decisions.push_back({row["decision"], row["path"]});
+  }
+
+  std::vector<std::pair<std::string, std::string>> expected_decisions = {
+      {"DENY", "/Users/bob/Downloads/denied"},
+      {"ALLOW", "/Users/bob/Downloads/allowed"}};
+  EXPECT_EQ(decisions, expected_decisions);
+
+  osquery::EventFactory::deregisterEventSubscriber(subscriber->getName());
+  osquery::EventFactory::deregisterEventPublisher(publisher->type());
+}
+
+INSTANTIATE_TEST_SUITE_P(Watchers,
+                         LogWatcherTests,
+                         testing::Values(false, true),
+                         [](const testing::TestParamInfo<bool>& info) {
+                           return info.param ? "polling" : "notifications";
+                         });
+
+} // namespace
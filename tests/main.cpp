@@ -0,0 +1,16 @@
+// Description: The entry point of the Santa extension tests
+#include <gtest/gtest.h>
+
+#include <osquery/database/database.h>
+#include <osquery/registry/registry_factory.h>
+
+int main(int argc, char* argv[]) {
+  testing::InitGoogleTest(&argc, argv);
+
+  // The evented table stores what its subscriber records in osquery's
+  // database, an in-memory one here
+  osquery::registryAndPluginInit();
+  osquery::initDatabasePluginForTesting();
+
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,202 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sqlite3.h>
+
+#include "pathmatcher.h"
+
+namespace {
+
+PathPattern like(const std::string& text) {
+  return {PathPattern::Syntax::Like, text};
+}
+
+PathPattern glob(const std::string& text) {
+  return {PathPattern::Syntax::Glob, text};
+}
+
+bool matches(const std::vector<PathPattern>& patterns,
+             const std::string& value) {
+  return PathMatcher(patterns).matches(value);
+}
+
+// Values and patterns the matcher is compared with SQLite on, one pattern
+// at a time. "\xC3\xA9" is é and "\xC3\x89" É, which LIKE does not fold.
+const std::vector<std::string> kValues = {
+    "",
+    "/Applications/Safari.app/Contents/MacOS/Safari",
+    "/applications/safari.app/contents/macos/safari",
+    "/Users/bob/Downloads/allowed",
+    "/Users/bob/Downloads/denied",
+    "/Users/bob/Downloads/100%_done",
+    "/Users/bob/Downloads/caf\xC3\xA9",
+    "/Users/bob/Downloads/CAF\xC3\x89",
+    "/tmp/a]b",
+    "/tmp/x-y",
+};
+
+const std::vector<PathPattern> kPatterns = {
+    like(""),
+    like("%"),
+    like("_"),
+    like("%%"),
+    like("/users/%/downloads/%"),
+    like("%/Downloads/_llowed"),
+    like("%SAFARI"),
+    like("%100%\\_done"),
+    like("%caf_"),
+    like("%caf\xC3\xA9"),
+    like("%caf\xC3\x89"),
+    glob(""),
+    glob("*"),
+    glob("?"),
+    glob("/Applications/*.app/*"),
+    glob("/applications/*"),
+    glob("/Users/bob/Downloads/[a-d]*"),
+    glob("/Users/bob/Downloads/[^a-d]*"),
+    glob("*caf?"),
+    glob("/tmp/a[]]b"),
+    glob("/tmp/x[-]y"),
+    glob("/tmp/[a-z]*"),
+    glob("/tmp/[abc"),
+    glob("*%*"),
+};
+
+class PathMatcherTests : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(sqlite3_open_v2(
+                  ":memory:", &db_, SQLITE_OPEN_READWRITE, nullptr),
+              SQLITE_OK);
+  }
+
+  void TearDown() override {
+    sqlite3_close(db_);
+  }
+
+  // What SQLite answers to value LIKE pattern or value GLOB pattern
+  bool sqliteMatches(const PathPattern& pattern, const std::string& value) {
+    auto query = (pattern.syntax == PathPattern::Syntax::Like)
+                     ? "SELECT ?1 LIKE ?2"
+                     : "SELECT ?1 GLOB ?2";
+
+    sqlite3_stmt* statement = nullptr;
+    EXPECT_EQ(sqlite3_prepare_v2(db_, query, -1, &statement, nullptr),
+              SQLITE_OK);
+    sqlite3_bind_text(
+        statement, 1, value.data(), static_cast<int>(value.size()), nullptr);
+    sqlite3_bind_text(statement,
+                      2,
+                      pattern.text.data(),
+                      static_cast<int>(pattern.text.size()),
+                      nullptr);
+
+    EXPECT_EQ(sqlite3_step(statement), SQLITE_ROW);
+    auto result = sqlite3_column_int(statement, 0) != 0;
+    sqlite3_finalize(statement);
+    return result;
+  }
+
+  sqlite3* db_{nullptr};
+};
+
+TEST_F(PathMatcherTests, test_agrees_with_sqlite) {
+  for (const auto& pattern : kPatterns) {
+    for (const auto& value : kValues) {
+      EXPECT_EQ(matches({pattern}, value), sqliteMatches(pattern, value))
+          << (pattern.syntax == PathPattern::Syntax::Like ? "LIKE " : "GLOB ")
+          << pattern.text << " on " << value;
+    }
+  }
+}
+
+TEST_F(PathMatcherTests, test_like_ignores_ascii_case_only) {
+  EXPECT_TRUE(matches({like("/USERS/BOB/%")}, "/Users/bob/Downloads/denied"));
+  EXPECT_TRUE(
+      matches({like("%/Caf\xC3\xA9")}, "/Users/bob/Downloads/caf\xC3\xA9"));
+  EXPECT_FALSE(
+      matches({like("%/caf\xC3\x89")}, "/Users/bob/Downloads/caf\xC3\xA9"));
+}
+
+TEST_F(PathMatcherTests, test_like_wildcards) {
+  EXPECT_TRUE(
+      matches({like("/Users/%/allowed")}, "/Users/bob/Downloads/allowed"));
+  EXPECT_TRUE(matches({like("/Users/b_b/%")}, "/Users/bob/Downloads/allowed"));
+  EXPECT_FALSE(matches({like("/Users/b_/%")}, "/Users/bob/Downloads/allowed"));
+
+  // _ is one character, not one byte
+  EXPECT_TRUE(matches({like("%/caf_")}, "/Users/bob/Downloads/caf\xC3\xA9"));
+
+  // GLOB wildcards are literals to LIKE
+  EXPECT_FALSE(matches({like("/Users/*")}, "/Users/bob/Downloads/allowed"));
+}
+
+TEST_F(PathMatcherTests, test_glob_is_case_sensitive) {
+  EXPECT_TRUE(matches({glob("/Applications/*")},
+                      "/Applications/Safari.app/Contents/MacOS/Safari"));
+  EXPECT_FALSE(matches({glob("/applications/*")},
+                       "/Applications/Safari.app/Contents/MacOS/Safari"));
+}
+
+TEST_F(PathMatcherTests, test_glob_wildcards_and_classes) {
+  EXPECT_TRUE(matches({glob("/tmp/?")}, "/tmp/a"));
+  EXPECT_FALSE(matches({glob("/tmp/?")}, "/tmp/ab"));
+  EXPECT_TRUE(matches({glob("/tmp/[a-c]")}, "/tmp/b"));
+  EXPECT_FALSE(matches({glob("/tmp/[a-c]")}, "/tmp/d"));
+  EXPECT_TRUE(matches({glob("/tmp/[^a-c]")}, "/tmp/d"));
+  EXPECT_TRUE(matches({glob("/tmp/a[]]b")}, "/tmp/a]b"));
+
+  // An unterminated class matches nothing
+  EXPECT_FALSE(matches({glob("/tmp/[abc")}, "/tmp/[abc"));
+
+  // LIKE wildcards are literals to GLOB
+  EXPECT_FALSE(matches({glob("/tmp/%")}, "/tmp/a"));
+}
+
+TEST_F(PathMatcherTests, test_patterns_are_anded) {
+  std::vector<PathPattern> patterns = {like("/users/%"), glob("*/allowed")};
+
+  EXPECT_TRUE(matches(patterns, "/Users/bob/Downloads/allowed"));
+  EXPECT_FALSE(matches(patterns, "/Users/bob/Downloads/denied"));
+  EXPECT_FALSE(matches(patterns, "/tmp/allowed"));
+
+  patterns.push_back(glob("/Users/alice/*"));
+  EXPECT_FALSE(matches(patterns, "/Users/bob/Downloads/allowed"));
+}
+
+TEST_F(PathMatcherTests, test_patterns_without_literals) {
+  for (const auto& pattern : {like("%"), like("%%"), glob("*")}) {
+    PathMatcher matcher({pattern});
+    EXPECT_TRUE(matcher.mayMatch(""));
+    EXPECT_TRUE(matcher.matches(""));
+    EXPECT_TRUE(matcher.matches("/Users/bob/Downloads/allowed"));
+  }
+
+  PathMatcher any_char({like("_"), glob("?")});
+  EXPECT_TRUE(any_char.mayMatch(""));
+  EXPECT_FALSE(any_char.matches(""));
+  EXPECT_TRUE(any_char.matches("\xC3\xA9"));
+  EXPECT_FALSE(any_char.matches("ab"));
+
+  PathMatcher char_class({glob("[a-z]*")});
+  EXPECT_TRUE(char_class.matches("tmp"));
+  EXPECT_FALSE(char_class.matches("/tmp"));
+}
+
+TEST_F(PathMatcherTests, test_may_match_needs_every_fragment) {
+  PathMatcher matcher({like("/users/%/downloads/%"), glob("*.app*")});
+
+  // The fragments are found anywhere in a log line, ignoring case
+  EXPECT_TRUE(matcher.mayMatch(
+      "[2026-10-29T17:10:30.849Z] I santad: action=EXEC|decision=ALLOW|"
+      "path=/Users/bob/Downloads/Tool.app/Contents/MacOS/Tool"));
+  EXPECT_FALSE(matcher.mayMatch("path=/Users/bob/Downloads/allowed"));
+
+  // Only the value is checked against the patterns themselves
+  EXPECT_TRUE(matcher.matches("/Users/bob/Downloads/Tool.app/Contents/Tool"));
+  EXPECT_FALSE(matcher.matches("/Users/bob/Downloads/Tool.APP/Contents/Tool"));
+}
+
+} // namespace